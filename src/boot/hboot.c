@@ -5,6 +5,7 @@
 #include "at45db011.h"
 #include <avr/eeprom.h>
 #include <kern/lock.h>
+#include "hal/spi.h"
 
 #define eeprom_wb(addr,val) eeprom_write_byte ((uint8_t *)(addr),(uint8_t)(val))
 #define eeprom_rb(addr) eeprom_read_byte ((uint8_t *)(addr))
@@ -24,6 +25,8 @@ void acquire(struct lock *k) {}
 int try_acquire(struct lock *k) {return 1;}
 void release(struct lock *k) {}
 void init_lock(struct lock *k, const char *name) {}
+int8_t spi_acquire() {return SPI_READY;}
+void spi_release() {}
 
 // pointer to the start of the Main App.
 void (*appBoot)(void) = 0x0000;
@@ -28,6 +28,7 @@
 #include <kern/global.h>
 #include <kern/thread.h>
 #include <mcp3008.h>
+#include <sampler.h>
 
 #else
 
@@ -35,39 +36,32 @@
 
 #endif
 
-uint16_t analog_read(uint8_t port) {
-	
-	#ifndef SIMULATE
+#ifndef SIMULATE
 
-    uint16_t v;
-    if (port>=8 && port<16) {
-        // keep trying until sample is successful...
-        while (mcp3008_get_sample(MCP3008_ADC1, MCP3008_CH0+(15-port), &v)
-                != MCP3008_SUCCESS) {
-            // XXX: for now notify user of fail
-            panic("mcp3008 fail");
+uint8_t analog_port_channel(uint8_t port) {
+    if (port>=8 && port<16)
+        return SAMPLER_CHANNEL(MCP3008_ADC1, 15-port);
+    else if (port>=16 && port<24)
+        return SAMPLER_CHANNEL(MCP3008_ADC2, 23-port);
 
-            // yield and try again
-            yield();
-        }
-    }
+    panic("analog_read");
+}
+
+uint16_t analog_read_fresh(uint8_t port) {
+    return sampler_read_fresh(analog_port_channel(port));
+}
 
-    else if (port>=16 && port<24) {
-        while (mcp3008_get_sample(MCP3008_ADC2, MCP3008_CH0+(23-port), &v)
-                != MCP3008_SUCCESS) {
-            // XXX: for now notify user of fail
-            panic("mcp3008 fail");
+uint16_t analog_read_filtered(uint8_t port) {
+    return sampler_read_filtered(analog_port_channel(port));
+}
 
-            // yield and try again
-            yield();
-        }
-    }
+#endif
 
-    else {
-        panic("analog_read");
-    }
+uint16_t analog_read(uint8_t port) {
+	
+	#ifndef SIMULATE
 
-    return v;
+    return sampler_read(analog_port_channel(port));
 
 	#else
 
@@ -76,4 +70,3 @@ uint16_t analog_read(uint8_t port) {
 	#endif
 
 }
-
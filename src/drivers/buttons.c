@@ -30,7 +30,13 @@
 #include "hal/delay.h"
 #include "hal/adc.h"
 #include "mcp3008.h"
+#include "sampler.h"
 #include <buttons.h>
+#include <kern/lock.h>
+#include <kern/log.h>
+#include <kern/periodic.h>
+#include <kern/thread.h>
+#include <avr/interrupt.h>
 
 #else
 
@@ -54,18 +60,316 @@
 #define VBAT_MULT ((VBAT_ADC*(VBAT_R1+VBAT_R2)*1000.0)/(VBAT_RES*VBAT_R1))
 #define VBAT_ADC_TO_MV(x) ((uint16_t)(((float)(x))*VBAT_MULT))
 
+#define VBAT_CHANNEL        SAMPLER_CHANNEL(MCP3008_MOTOR, 7)
+// sample every 20ms, and smooth over roughly half a second
+#define VBAT_SAMPLE_PERIOD  20
+#define VBAT_CHECK_PERIOD   100
+// the battery must recover this far above the threshold to stop being low
+#define VBAT_HYSTERESIS     200
+
+static struct lock battery_lock;
+static struct periodic_task battery_task;
+static uint16_t battery_low_mv = BATTERY_LOW_DEFAULT_MV;
+static uint8_t battery_low = 0;
+static battery_handler battery_handlers[BATTERY_HANDLERS];
+
+static void battery_check(void *arg) {
+    uint16_t mv = read_battery_filtered();
+    uint8_t changed = 0;
+
+    acquire(&battery_lock);
+    if (!battery_low && mv < battery_low_mv) {
+        battery_low = 1;
+        changed = 1;
+    } else if (battery_low && mv >= battery_low_mv + VBAT_HYSTERESIS) {
+        battery_low = 0;
+        changed = 1;
+    }
+    uint8_t low = battery_low;
+    release(&battery_lock);
+
+    if (!changed)
+        return;
+
+    if (low)
+        log_warn("battery low: %u mV", mv);
+    for (uint8_t h = 0; h < BATTERY_HANDLERS; h++) {
+        if (battery_handlers[h])
+            battery_handlers[h](mv, low);
+    }
+}
+
+void battery_init(void) {
+    init_lock(&battery_lock, "battery lock");
+    sampler_enable(VBAT_CHANNEL, VBAT_SAMPLE_PERIOD);
+    sampler_add_filter(VBAT_CHANNEL, SAMPLER_FILTER_MEDIAN, 5);
+    sampler_add_filter(VBAT_CHANNEL, SAMPLER_FILTER_EMA, SAMPLER_EMA_ALPHA(0.05));
+    periodic_add(&battery_task, battery_check, NULL, VBAT_CHECK_PERIOD);
+}
+
+uint16_t read_battery_filtered(void) {
+    return VBAT_ADC_TO_MV(sampler_read_filtered(VBAT_CHANNEL));
+}
+
+void battery_set_low_threshold(uint16_t mv) {
+    acquire(&battery_lock);
+    battery_low_mv = mv;
+    release(&battery_lock);
+}
+
+uint8_t battery_is_low(void) {
+    return battery_low;
+}
+
+int8_t battery_subscribe(battery_handler handler) {
+    int8_t ret = -1;
+    acquire(&battery_lock);
+    for (uint8_t h = 0; h < BATTERY_HANDLERS; h++) {
+        if (!battery_handlers[h]) {
+            battery_handlers[h] = handler;
+            ret = 0;
+            break;
+        }
+    }
+    release(&battery_lock);
+    return ret;
+}
+
+// a button must read the same for this many samples to change state
+#define BUTTON_DEBOUNCE     4
+// must be a power of two
+#define BUTTON_QUEUE_SIZE   8
+
+extern struct thread *current_thread;
+
+static struct periodic_task button_task;
+static uint8_t button_state = 0;        // debounced, bit per button
+static uint8_t button_count[BUTTONS];   // samples disagreeing with the state
+static uint16_t button_held[BUTTONS];   // sample periods held down
+static uint8_t button_queue[BUTTON_QUEUE_SIZE];
+static volatile uint8_t button_head = 0;
+static volatile uint8_t button_tail = 0;
+
+static uint8_t button_raw(uint8_t button) {
+    return button == BUTTON_GO ? SWITCH_GO() : SWITCH_STOP();
+}
+
+static uint8_t button_raw_all(void) {
+    return (SWITCH_GO() ? _BV(BUTTON_GO) : 0) |
+        (SWITCH_STOP() ? _BV(BUTTON_STOP) : 0);
+}
+
+// called from the periodic thread
+static void button_push(uint8_t event) {
+    ATOMIC_BEGIN;
+    // drop the event if nobody is reading them
+    if ((uint8_t)(button_head - button_tail) < BUTTON_QUEUE_SIZE) {
+        button_queue[button_head++ & (BUTTON_QUEUE_SIZE-1)] = event;
+        thread_wakeup(button_queue);
+    }
+    ATOMIC_END;
+}
+
+static void button_sample(void *arg) {
+    for (uint8_t b = 0; b < BUTTONS; b++) {
+        uint8_t down = button_raw(b) ? 1 : 0;
+        uint8_t was_down = (button_state >> b) & 1;
+
+        if (was_down && button_held[b] < 0xFFFF) {
+            button_held[b]++;
+            if (button_held[b] == BUTTON_LONG_MS / BUTTON_SAMPLE_PERIOD)
+                button_push(BUTTON_EVENT(b, BUTTON_LONG));
+        }
+
+        if (down == was_down) {
+            button_count[b] = 0;
+            continue;
+        }
+        if (++button_count[b] < BUTTON_DEBOUNCE)
+            continue;
+
+        button_count[b] = 0;
+        button_held[b] = 0;
+        button_state ^= _BV(b);
+        button_push(BUTTON_EVENT(b, down ? BUTTON_PRESS : BUTTON_RELEASE));
+    }
+}
+
+void buttons_init(void) {
+    button_state = button_raw_all();
+    periodic_add(&button_task, button_sample, NULL, BUTTON_SAMPLE_PERIOD);
+}
+
+// the event queue is only fed once the scheduler is running
+static uint8_t buttons_running(void) {
+    return current_thread && (SREG & SREG_IF);
+}
+
+uint8_t button_get_event(uint32_t timeout) {
+    uint8_t event = 0;
+    uint32_t end = get_time() + timeout;
+
+    ATOMIC_BEGIN;
+    while (button_head == button_tail) {
+        if (timeout == BUTTON_WAIT_FOREVER) {
+            thread_sleep(button_queue);
+        } else {
+            uint32_t now = get_time();
+            if ((int32_t)(end - now) <= 0)
+                break;
+            thread_sleep_timeout(button_queue, end - now);
+        }
+    }
+    if (button_head != button_tail)
+        event = button_queue[button_tail++ & (BUTTON_QUEUE_SIZE-1)];
+    ATOMIC_END;
+
+    return event;
+}
+
+void button_flush_events(void) {
+    ATOMIC_BEGIN;
+    button_tail = button_head;
+    ATOMIC_END;
+}
+
+// wait for a press and release of one of the buttons in mask, returns the
+// button released
+static uint8_t button_click(uint8_t mask) {
+    uint8_t pressed = 0;
+
+    if (!buttons_running()) {
+        // no periodic thread yet (board_fail), so poll
+        while (!(pressed = button_raw_all() & mask));
+        delay_busy_us(100);
+        while (button_raw_all() & mask);
+        return (pressed & _BV(BUTTON_GO)) ? BUTTON_GO : BUTTON_STOP;
+    }
+
+    // only count presses made after the call
+    button_flush_events();
+    for (;;) {
+        uint8_t event = button_get_event(BUTTON_WAIT_FOREVER);
+        uint8_t b = BUTTON_EVENT_BUTTON(event);
+        if (!(mask & _BV(b)))
+            continue;
+        if (BUTTON_EVENT_TYPE(event) == BUTTON_PRESS)
+            pressed |= _BV(b);
+        else if (BUTTON_EVENT_TYPE(event) == BUTTON_RELEASE && (pressed & _BV(b)))
+            return b;
+    }
+}
+
+// must be a power of two
+#define BEEP_QUEUE_SIZE     8
+
+static const uint16_t beep_prescale[] = { 1, 8, 32, 64, 128, 256, 1024 };
+
+static struct beep_tone beep_queue[BEEP_QUEUE_SIZE];
+static volatile uint8_t beep_head = 0;
+static volatile uint8_t beep_tail = 0;
+static volatile uint8_t beep_playing = 0;
+static volatile uint16_t beep_left;     // milliseconds left of the current tone
+
+// Timer 0 in CTC mode toggles OC0 (the beeper pin) on every compare match,
+// so the tone needs no interrupts. freq 0 silences the beeper.
+static void beep_set_freq(uint16_t freq) {
+    if (!freq) {
+        TCCR0 = 0;
+        BEEPER(0);
+        return;
+    }
+
+    // timer counts per half period
+    uint32_t div = F_CPU / 2 / freq;
+    uint8_t cs;
+    for (cs = 0; cs < 6; cs++) {
+        if (div / beep_prescale[cs] <= 256)
+            break;
+    }
+    div /= beep_prescale[cs];
+    if (div > 256)
+        div = 256;
+    else if (div == 0)
+        div = 1;
+
+    TCCR0 = 0;
+    TCNT0 = 0;
+    OCR0 = div - 1;
+    TCCR0 = _BV(WGM01) | _BV(COM00) | (cs + 1);
+}
+
+// start the next queued tone; call with interrupts disabled
+static void beep_next(void) {
+    if (beep_head == beep_tail) {
+        beep_set_freq(0);
+        beep_playing = 0;
+        thread_wakeup(beep_queue);
+        return;
+    }
+
+    struct beep_tone *t = &beep_queue[beep_tail & (BEEP_QUEUE_SIZE-1)];
+    beep_left = t->duration;
+    beep_set_freq(t->freq);
+    beep_tail++;
+    beep_playing = 1;
+}
+
+void beeper_tick(void) {
+    if (!beep_playing)
+        return;
+    if (beep_left)
+        beep_left--;
+    if (!beep_left)
+        beep_next();
+}
+
+int8_t beep_sequence(const struct beep_tone *tones, uint8_t n) {
+    int8_t ret = -1;
+
+    ATOMIC_BEGIN;
+    if (BEEP_QUEUE_SIZE - (uint8_t)(beep_head - beep_tail) >= n) {
+        for (uint8_t i = 0; i < n; i++)
+            beep_queue[beep_head++ & (BEEP_QUEUE_SIZE-1)] = tones[i];
+        if (!beep_playing)
+            beep_next();
+        ret = 0;
+    }
+    ATOMIC_END;
+
+    return ret;
+}
+
+int8_t beep_async(uint16_t freq, uint16_t duration) {
+    struct beep_tone t = { freq, duration };
+    return beep_sequence(&t, 1);
+}
+
+void beep_stop(void) {
+    ATOMIC_BEGIN;
+    beep_tail = beep_head;
+    beep_next();
+    ATOMIC_END;
+}
+
+uint8_t beep_busy(void) {
+    return beep_playing;
+}
+
+void beep_wait(void) {
+    ATOMIC_BEGIN;
+    while (beep_playing)
+        thread_sleep(beep_queue);
+    ATOMIC_END;
+}
+
 #endif
 
 int either_click() {
 	
 	#ifndef SIMULATE
 
-    int which = 0;
-    while (!SWITCH_GO() && !SWITCH_STOP());
-    which = SWITCH_GO();
-    delay_busy_us(100);
-    while (SWITCH_GO() || SWITCH_STOP());
-    return which;
+    return button_click(_BV(BUTTON_GO) | _BV(BUTTON_STOP)) == BUTTON_GO;
 
 	#else
 
@@ -81,9 +385,7 @@ void go_click() {
 
 	#ifndef SIMULATE
 
-    while (!SWITCH_GO());
-    delay_busy_us(100);
-    while (SWITCH_GO());
+    button_click(_BV(BUTTON_GO));
 
 	#else
 
@@ -97,9 +399,7 @@ void stop_click() {
 
 	#ifndef SIMULATE
 
-    while (!SWITCH_STOP());
-    delay_busy_us(100);
-    while (SWITCH_STOP());
+    button_click(_BV(BUTTON_STOP));
 
 	#else
 
@@ -113,7 +413,9 @@ uint8_t go_press() {
 
 	#ifndef SIMULATE
 
-    return SWITCH_GO();
+    if (!buttons_running())
+        return SWITCH_GO();
+    return (button_state >> BUTTON_GO) & 1;
 
 	#else
 
@@ -128,7 +430,9 @@ uint8_t stop_press() {
 
 	#ifndef SIMULATE
 
-    return SWITCH_STOP();
+    if (!buttons_running())
+        return SWITCH_STOP();
+    return (button_state >> BUTTON_STOP) & 1;
 
 	#else
 
@@ -178,8 +482,7 @@ uint16_t read_battery() {
 
 	#ifndef SIMULATE
 
-    uint16_t v;
-    mcp3008_get_sample(MCP3008_MOTOR, MCP3008_CH7,&v);
+    uint16_t v = sampler_read(SAMPLER_CHANNEL(MCP3008_MOTOR, 7));
     return VBAT_ADC_TO_MV(v);
 
 	#else
@@ -194,7 +497,17 @@ uint16_t read_battery() {
 void beep(uint16_t freq, uint16_t duration) {
 
 	#ifndef SIMULATE
-	
+
+    if (buttons_running()) {
+        while (beep_async(freq, duration) < 0)
+            beep_wait();
+        beep_wait();
+        return;
+    }
+
+    // without the system tick a queued tone would never end, so toggle the
+    // pin by hand during boot and panic
+    beep_set_freq(0);
     uint32_t count=(((uint32_t)duration)*freq)/1000ul;
     uint16_t p = 500000ul / freq;
     while (count--) {
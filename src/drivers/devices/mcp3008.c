@@ -31,32 +31,36 @@
 #include "hal/spi.h"
 #include <kern/global.h>
 
-int8_t mcp3008_get_sample(mcp3008_device dev, mcp3008_input config, uint16_t *sample) {
-    uint8_t cmd[3];
-
-    if (spi_acquire() == SPI_IN_USE)
-        return MCP3008_SPI_BUSY;
-
+void mcp3008_prepare(struct spi_transaction *t, mcp3008_device dev, mcp3008_input config, uint8_t *cmd) {
     cmd[0] = 0x40 | (config << 2);
 
-    spi_set_master (SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-
-    switch (dev) {
-        case MCP3008_MOTOR: SPI_MOTOR_SS(0); break;
-        case MCP3008_ADC1:  SPI_ADC1_SS(0); break;
-        case MCP3008_ADC2:  SPI_ADC2_SS(0); break;
-    }
-    spi_transfer_sync (cmd, 3);
     switch (dev) {
-        case MCP3008_MOTOR: SPI_MOTOR_SS(1); break;
-        case MCP3008_ADC1:  SPI_ADC1_SS(1); break;
-        case MCP3008_ADC2:  SPI_ADC2_SS(1); break;
+        case MCP3008_MOTOR: t->dev = SPI_DEV_MOTOR; break;
+        case MCP3008_ADC1:  t->dev = SPI_DEV_ADC1; break;
+        case MCP3008_ADC2:  t->dev = SPI_DEV_ADC2; break;
+        default:            t->dev = SPI_DEV_NONE; break;
     }
+    t->div = SPI_CLK_DIV_16;
+    t->flags = SPI_FLAGS_DEFAULT;
+    t->tx = cmd;
+    t->len = 3;
+}
+
+uint16_t mcp3008_decode(uint8_t *rx) {
+    return (((uint16_t)rx[1] << 8) | rx[2]) >> 6;
+}
+
+int8_t mcp3008_get_sample(mcp3008_device dev, mcp3008_input config, uint16_t *sample) {
+    uint8_t cmd[3];
+    struct spi_transaction t;
+
+    mcp3008_prepare(&t, dev, config, cmd);
+    t.rx = cmd;
+    t.done = NULL;
 
-    *sample = ((uint16_t)cmd[1] << 8) | cmd[2];
-    *sample >>= 6;
+    spi_transfer(&t);
 
-    spi_release();
+    *sample = mcp3008_decode(cmd);
 
     return MCP3008_SUCCESS;
 }
@@ -37,141 +37,101 @@
 #include <nrf24l01.h>
 #include <rf.h>
 
-uint8_t nrf_read_status(void) {
+// The nRF24L01 takes SPI clocks up to 8MHz, so run it as fast as we can
+#define NRF_SPI_DIV SPI_CLK_DIV_2
+
+void nrf_begin(void) {
     spi_acquire();
-    uint8_t cmd[1];
-    cmd[0] = NRF_SPI_NOP;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
+    spi_set_master(NRF_SPI_DIV, SPI_FLAGS_DEFAULT);
+}
+
+void nrf_end(void) {
+    spi_release();
+}
+
+// run one SPI command on the nRF, in place
+static uint8_t nrf_command(uint8_t *cmd, uint8_t len) {
+    nrf_begin();
     SPI_RF_SS(0);
-    spi_transfer_sync(cmd,1);
+    spi_transfer_sync(cmd,len);
     SPI_RF_SS(1);
-    spi_release();
+    nrf_end();
     return cmd[0];
 }
 
+uint8_t nrf_read_status(void) {
+    uint8_t cmd[1];
+    cmd[0] = NRF_SPI_NOP;
+    return nrf_command(cmd,1);
+}
+
 uint8_t nrf_read_reg(uint8_t reg) {
-    spi_acquire();
     uint8_t cmd[2];
     cmd[0] = NRF_SPI_R_REGISTER | reg;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,2);
-    SPI_RF_SS(1);
-    spi_release();
+    nrf_command(cmd,2);
     return cmd[1];
 }
 
 uint8_t nrf_read_multibyte_reg(uint8_t reg, uint8_t *data, uint8_t len) {
-    spi_acquire();
     uint8_t cmd[6];
     cmd[0] = NRF_SPI_R_REGISTER | reg;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,len+1);
-    SPI_RF_SS(1);
-    spi_release();
+    nrf_command(cmd,len+1);
     memcpy(data, cmd+1, len);
     return cmd[0];
 }
 
 uint8_t nrf_write_reg(uint8_t reg, uint8_t data) {
-    spi_acquire();
     uint8_t cmd[2];
     cmd[0] = NRF_SPI_W_REGISTER | reg;
     cmd[1] = data;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,2);
-    SPI_RF_SS(1);
-    spi_release();
-    return cmd[0];
+    return nrf_command(cmd,2);
 }
 
 uint8_t nrf_write_multibyte_reg(uint8_t reg, uint8_t *data, uint8_t len) {
-    spi_acquire();
     uint8_t cmd[6];
     cmd[0] = NRF_SPI_W_REGISTER | reg;
     memcpy(cmd+1, data, len);
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,len+1);
-    SPI_RF_SS(1);
-    spi_release();
-    return cmd[0];
+    return nrf_command(cmd,len+1);
 }
 
 uint8_t nrf_read_rx_payload_len() {
-    spi_acquire();
     uint8_t cmd[2];
     cmd[0] = NRF_SPI_R_RX_LP_WID;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,2);
-    SPI_RF_SS(1);
-    spi_release();
+    nrf_command(cmd,2);
     return cmd[1];
 }
 
 uint8_t nrf_read_rx_payload(uint8_t *data, uint8_t len) {
-    spi_acquire();
     uint8_t cmd[33];
     cmd[0] = NRF_SPI_R_RX_PAYLOAD;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,len+1);
-    SPI_RF_SS(1);
-    spi_release();
+    nrf_command(cmd,len+1);
     memcpy(data, cmd+1, len);
     return cmd[0];
 }
 
 uint8_t nrf_flush_tx() {
-    spi_acquire();
     uint8_t cmd[1];
     cmd[0] = NRF_SPI_FLUSH_TX;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,1);
-    SPI_RF_SS(1);
-    spi_release();
-    return cmd[0];
+    return nrf_command(cmd,1);
 }
 
 uint8_t nrf_flush_rx() {
-    spi_acquire();
     uint8_t cmd[1];
     cmd[0] = NRF_SPI_FLUSH_RX;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,1);
-    SPI_RF_SS(1);
-    spi_release();
-    return cmd[0];
+    return nrf_command(cmd,1);
 }
 
 uint8_t nrf_reuse_tx_pl() {
-    spi_acquire();
     uint8_t cmd[1];
     cmd[0] = NRF_SPI_REUSE_TX_PL;
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,1);
-    SPI_RF_SS(1);
-    spi_release();
-    return cmd[0];
+    return nrf_command(cmd,1);
 }
 
 uint8_t nrf_write_tx_payload(uint8_t *data, uint8_t len) {
-    spi_acquire();
     uint8_t cmd[33];
     cmd[0] = NRF_SPI_W_TX_PAYLOAD;
     memcpy(cmd+1,data,len);
-    spi_set_master(SPI_CLK_DIV_16, SPI_FLAGS_DEFAULT);
-    SPI_RF_SS(0);
-    spi_transfer_sync(cmd,len+1);
-    SPI_RF_SS(1);
-    spi_release();
-    return cmd[0];
+    return nrf_command(cmd,len+1);
 }
 
 #endif
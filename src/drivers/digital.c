@@ -28,8 +28,11 @@
 #include <config.h>
 #include <fpga.h>
 #include <analog.h>
+#include <digital.h>
+#include <sampler.h>
 #include <kern/lock.h>
 #include <kern/global.h>
+#include <kern/periodic.h>
 
 #else
 
@@ -41,10 +44,87 @@
 
 struct lock digital_lock;
 
+// software edge counting, for FPGA images without edge counters
+#define DIGITAL_COUNT_POLL_PERIOD 5
+
+static uint8_t digital_hw_count = 0;
+static uint16_t digital_count_zero[8];
+static uint16_t digital_sw_count[8];
+static uint8_t digital_sw_last = 0;
+static struct periodic_task digital_count_task;
+
+// nonzero once the analog ports are being sampled for digital_read_all()
+static uint8_t digital_analog_enabled = 0;
+
 void digital_init () {
     init_lock(&digital_lock, "digital lock");
 }
 
+static void digital_count_poll(void *arg) {
+    uint8_t now = digital_read_8();
+    uint8_t pressed = now & ~digital_sw_last;
+    digital_sw_last = now;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (pressed & (1 << i))
+            digital_sw_count[i]++;
+    }
+}
+
+void digital_probe (void) {
+    digital_hw_count = fpga_version_at_least(0, 12);
+    if (!digital_hw_count) {
+        digital_sw_last = digital_read_8();
+        periodic_add(&digital_count_task, digital_count_poll, NULL,
+                DIGITAL_COUNT_POLL_PERIOD);
+    }
+}
+
+static uint16_t digital_count_raw(uint8_t port) {
+    if (!digital_hw_count)
+        return digital_sw_count[port];
+
+    acquire(&digital_lock);
+    // reading the low byte latches the high byte
+    uint8_t base = FPGA_DIGITAL_COUNT_BASE + port*FPGA_DIGITAL_COUNT_SIZE;
+    uint16_t result = fpga_read_byte(base);
+    result |= fpga_read_byte(base+1) << 8;
+    release(&digital_lock);
+    return result;
+}
+
+uint16_t digital_count(uint8_t port) {
+    if (port > 7)
+        panic("digital_count");
+    return digital_count_raw(port) - digital_count_zero[port];
+}
+
+void digital_count_reset(uint8_t port) {
+    if (port > 7)
+        panic("digital_count_reset");
+    digital_count_zero[port] = digital_count_raw(port);
+}
+
+uint32_t digital_read_all(void) {
+    uint16_t values[16];
+    uint32_t result = digital_read_8();
+
+    if (!digital_analog_enabled) {
+        // the first read of each port starts it being sampled
+        for (uint8_t port = 8; port < 24; port++)
+            analog_read(port);
+        digital_analog_enabled = 1;
+    }
+
+    sampler_get_values(SAMPLER_CHANNEL(MCP3008_ADC1, 0), 16, values);
+    for (uint8_t port = 8; port < 24; port++) {
+        uint8_t i = analog_port_channel(port) - SAMPLER_CHANNEL(MCP3008_ADC1, 0);
+        if (values[i] > ((ANALOG_MAX+1)>>1))
+            result |= (uint32_t)1 << port;
+    }
+
+    return result;
+}
+
 #endif
 
 // Pin modes of digital IO: 1 = output
@@ -74,13 +154,18 @@ static inline void _set_digital_pinmode(uint8_t port, uint8_t output) {
         panic("_set_diital_pinmode");
     }
 
+    uint8_t pinmode = output_pinmode;
     if (output) {
-        output_pinmode |= (1 << port);
+        pinmode |= (1 << port);
     } else {
-        output_pinmode &= ~(1 << port);
+        pinmode &= ~(1 << port);
     }
 
-    fpga_write_byte(FPGA_DIGITAL_PINMODE, output_pinmode);
+    // the FPGA register only changes here, so skip writing the same value
+    if (pinmode != output_pinmode) {
+        output_pinmode = pinmode;
+        fpga_write_byte(FPGA_DIGITAL_PINMODE, output_pinmode);
+    }
 }
 
 uint8_t digital_read(uint8_t port) {
@@ -29,6 +29,9 @@
 #include <fpga.h>
 #include <encoder.h>
 #include <kern/lock.h>
+#include <kern/thread.h>
+#include <hal/io.h>
+#include <avr/interrupt.h>
 
 #else
 
@@ -39,21 +42,37 @@
 
 #endif
 
-#ifndef SIMULATE
-
 struct lock encoder_lock;
 
-#endif
-
 static uint16_t encoder_zero[4];
+static int32_t encoder_zero32[4];
 
-void encoder_init (void) {
+// nonzero if the FPGA has 32-bit counters
+static uint8_t encoder_hw32 = 0;
+// software extension of the 16-bit counters, for older FPGA images
+static int32_t encoder_ext[4];
+static uint16_t encoder_last[4];
 
-	#ifndef SIMULATE
+// nonzero if the FPGA times encoder counts
+static uint8_t encoder_hw_period = 0;
+// nonzero if the FPGA can latch all four counts at once
+static uint8_t encoder_hw_snap = 0;
+// switch from the period method to the count method at this many counts
+#define ENCODER_VEL_COUNTS 8
+// longest interval the count method averages over
+#define ENCODER_VEL_WINDOW_US 100000
+// count method state for encoder_get_velocity()
+static int32_t encoder_vel_count[4];
+static uint32_t encoder_vel_time[4];
+static int8_t encoder_vel_dir[4];
+// FPGA_ENCODER_MODE as last written
+static uint8_t encoder_quad_mode = 0;
+
+void encoder_init (void) {
 
     init_lock (&encoder_lock, "encoder lock");
 
-	#else
+	#ifdef SIMULATE
 
 	memset(encoder_zero, 0, 4);
 
@@ -94,10 +113,199 @@ uint16_t encoder_read_raw(uint8_t encoder) {
 
 }
 
+static int32_t encoder_read32_raw(uint8_t encoder) {
+
+	#ifndef SIMULATE
+
+    if (encoder_hw32) {
+        acquire (&encoder_lock);
+        // reading the low byte latches the upper three
+        uint8_t ebase = FPGA_ENCODER32_BASE + (encoder-24)*FPGA_ENCODER32_SIZE;
+        uint32_t result = fpga_read_byte(ebase);
+        result |= (uint32_t)fpga_read_byte(ebase+1) << 8;
+        result |= (uint32_t)fpga_read_byte(ebase+2) << 16;
+        result |= (uint32_t)fpga_read_byte(ebase+3) << 24;
+        release (&encoder_lock);
+        return (int32_t)result;
+    }
+
+	#endif
+
+    // the 16-bit counters only count up, so any difference is forward
+    acquire (&encoder_lock);
+    uint16_t raw = encoder_read_raw(encoder);
+    encoder_ext[encoder-24] += (uint16_t)(raw - encoder_last[encoder-24]);
+    encoder_last[encoder-24] = raw;
+    int32_t result = encoder_ext[encoder-24];
+    release (&encoder_lock);
+    return result;
+}
+
+void encoder_probe (void) {
+
+	#ifndef SIMULATE
+
+    encoder_hw32 = fpga_version_at_least(0, 8);
+    encoder_hw_period = fpga_version_at_least(0, 9);
+    encoder_hw_snap = fpga_version_at_least(0, 10);
+    if (encoder_hw32)
+        fpga_write_byte(FPGA_ENCODER_MODE, 0);
+
+	#endif
+
+    // start the software counts where the 16-bit counters are
+    for (uint8_t i = 0; i < 4; i++) {
+        encoder_last[i] = encoder_read_raw(24+i);
+        encoder_ext[i] = encoder_last[i];
+        encoder_vel_count[i] = encoder_read32_raw(24+i);
+        encoder_vel_time[i] = get_time_us();
+        encoder_vel_dir[i] = 1;
+    }
+
+}
+
 void encoder_reset(uint8_t encoder) {
     encoder_zero[encoder-24] = encoder_read_raw(encoder);
+    encoder_zero32[encoder-24] = encoder_read32_raw(encoder);
 }
 
 uint16_t encoder_read(uint8_t encoder) {
     return encoder_read_raw(encoder) - encoder_zero[encoder-24];
 }
+
+int32_t encoder_read32(uint8_t encoder) {
+    return encoder_read32_raw(encoder) - encoder_zero32[encoder-24];
+}
+
+void encoder_read_all(struct encoder_snapshot *snap) {
+
+    acquire (&encoder_lock);
+
+	#ifndef SIMULATE
+
+    if (encoder_hw_snap) {
+        uint8_t *p = (uint8_t*) snap;
+        fpga_write_byte(FPGA_ENCODER_SNAP_BASE, 0);
+        // the struct has the same little-endian layout as the registers
+        for (uint8_t i = 0; i < FPGA_ENCODER_SNAP_SIZE; i++)
+            p[i] = fpga_read_byte(FPGA_ENCODER_SNAP_BASE + i);
+        for (uint8_t i = 0; i < 4; i++)
+            snap->count[i] -= encoder_zero32[i];
+        release (&encoder_lock);
+        return;
+    }
+
+	#endif
+
+	#ifndef SIMULATE
+
+    // keep the reads as close together as possible
+    ATOMIC_BEGIN;
+    for (uint8_t i = 0; i < 4; i++)
+        snap->count[i] = encoder_read32_raw(24+i);
+    snap->time_us = get_time_us();
+    ATOMIC_END;
+
+	#else
+
+    for (uint8_t i = 0; i < 4; i++)
+        snap->count[i] = encoder_read32_raw(24+i);
+    snap->time_us = get_time_us();
+
+	#endif
+
+    for (uint8_t i = 0; i < 4; i++)
+        snap->count[i] -= encoder_zero32[i];
+
+    release (&encoder_lock);
+}
+
+int32_t encoder_get_velocity(uint8_t encoder) {
+    uint8_t i = encoder-24;
+    int32_t vel;
+
+    acquire (&encoder_lock);
+
+    int32_t count = encoder_read32_raw(encoder);
+    uint32_t now = get_time_us();
+    int32_t delta = count - encoder_vel_count[i];
+    uint32_t dt = now - encoder_vel_time[i];
+
+    if (delta > 0)
+        encoder_vel_dir[i] = 1;
+    else if (delta < 0)
+        encoder_vel_dir[i] = -1;
+
+	#ifndef SIMULATE
+
+    if (encoder_hw_period && delta < ENCODER_VEL_COUNTS && delta > -ENCODER_VEL_COUNTS) {
+        uint8_t ebase = FPGA_ENCODER_PERIOD_BASE + i*FPGA_ENCODER_PERIOD_SIZE;
+        // reading the low byte of the period latches the other three
+        uint16_t period = fpga_read_byte(ebase+FPGA_ENCODER_PERIOD);
+        period |= fpga_read_byte(ebase+FPGA_ENCODER_PERIOD+1) << 8;
+        uint16_t age = fpga_read_byte(ebase+FPGA_ENCODER_AGE);
+        age |= fpga_read_byte(ebase+FPGA_ENCODER_AGE+1) << 8;
+
+        // a count that is overdue bounds the speed from above
+        if (age > period)
+            period = age;
+        if (period == 0xFFFF)
+            vel = 0;
+        else
+            vel = encoder_vel_dir[i] *
+                (int32_t)(1000000000UL / FPGA_ENCODER_PERIOD_US / (period ? period : 1));
+
+        // don't let a slow shaft stretch the next count average too far
+        if (dt > ENCODER_VEL_WINDOW_US) {
+            encoder_vel_count[i] = count;
+            encoder_vel_time[i] = now;
+        }
+
+        release (&encoder_lock);
+        return vel;
+    }
+
+	#endif
+
+    vel = dt ? (int32_t)((int64_t)delta * 1000000000LL / dt) : 0;
+    encoder_vel_count[i] = count;
+    encoder_vel_time[i] = now;
+
+    release (&encoder_lock);
+    return vel;
+}
+
+uint8_t encoder_is_quadrature(uint8_t encoder) {
+    if (encoder == 24)
+        return encoder_quad_mode & 1;
+    if (encoder == 26)
+        return (encoder_quad_mode >> 1) & 1;
+    return 0;
+}
+
+int8_t encoder_set_quadrature(uint8_t encoder, uint8_t enabled) {
+    if ((encoder != 24 && encoder != 26) || !encoder_hw32)
+        return -1;
+
+	#ifndef SIMULATE
+
+    uint8_t bit = (encoder == 24) ? 1 : 2;
+    acquire (&encoder_lock);
+    uint8_t mode = fpga_read_byte(FPGA_ENCODER_MODE);
+    if (enabled)
+        mode |= bit;
+    else
+        mode &= ~bit;
+    fpga_write_byte(FPGA_ENCODER_MODE, mode);
+    encoder_quad_mode = mode;
+    release (&encoder_lock);
+
+	#endif
+
+    encoder_reset(encoder);
+    acquire (&encoder_lock);
+    encoder_vel_count[encoder-24] = encoder_read32_raw(encoder);
+    encoder_vel_time[encoder-24] = get_time_us();
+    release (&encoder_lock);
+    return 0;
+}
@@ -26,14 +26,158 @@
 #ifndef SIMULATE
 #include <joyos.h>
 
-float _lsb_us_per_deg = 0;
-volatile int64_t _theta = 0;
-volatile int32_t _theta_fix = 0;
-uint8_t _port = 11;
-volatile uint8_t _gyro_enabled = 0;
-uint16_t _offset = 0, _offset_fix = 0;
-uint16_t _fix_divisor;
-struct lock gyro_lock;
+/* The gyro is sampled by the sampler every GYRO_PERIOD_MS and integrated
+   in the sampler callback, in interrupt context, using the timestamp of
+   each sample for dt. Rates are converter LSBs in Q6 fixed point, and
+   theta is in LSB * us, also Q6:
+   1 deg/s = 5mV = 0.256 LSB for ADXRS300, 12.5mV = 0.64LSB for ADXRS150
+   1 deg = 0.256LSB * 1000000us = 256000 (given as lsb_us_per_deg) */
+
+#define GYRO_PERIOD_MS 1
+
+static float _lsb_us_per_deg = 0;
+static uint8_t _channel;
+static volatile int32_t _offset_q6 = 0;
+
+// heading, written by the callback and published through _theta_seq:
+// odd while an update is in progress
+static int64_t _theta = 0;
+static volatile uint8_t _theta_seq = 0;
+
+static int32_t _last_rate;
+static uint32_t _last_time_us;
+static uint8_t _primed = 0;
+
+static volatile uint8_t _calibrating = 0;
+static volatile uint32_t _cal_sum;
+static volatile uint16_t _cal_samples;
+
+static struct gyro_stats _stats;
+static uint32_t _dt_sum_us;
+
+/* Bias tracking: the rate is checked over windows of GYRO_WINDOW samples.
+   If it stayed close to the current offset with little variance, and the
+   drive motors were off, the robot is assumed not to be turning and the
+   offset moves toward the window's mean. */
+#define GYRO_WINDOW         64          // samples, power of 2
+#define GYRO_STILL_VAR_Q4   (4 << 4)    // max variance, LSB^2 in Q4
+#define GYRO_STILL_RATE_Q6  (2 << 6)    // max mean rate, LSB in Q6
+#define GYRO_BIAS_SHIFT     3           // move 1/8 of the way per window
+
+static int32_t _win_sum;                // rates, Q6
+static int32_t _win_sum_lsb;            // rates, LSB
+static uint32_t _win_sq;                // squared rates, LSB^2
+static uint8_t _win_n;
+static uint8_t _win_moving;             // drive motors ran during the window
+static uint8_t _idle_windows;           // windows in a row without drive motors
+static volatile uint16_t _variance_q4;
+static volatile uint8_t _stationary;
+static volatile uint8_t _hint = GYRO_HINT_AUTO;
+static volatile uint8_t _drive_motors = 0x3F;
+
+// called for every sample with the offset-corrected rate, in interrupt context
+static void gyro_track_bias(int32_t rate) {
+    int16_t lsb = (rate + 32) >> 6;
+
+    _win_sum += rate;
+    _win_sum_lsb += lsb;
+    _win_sq += (int32_t)lsb * lsb;
+    if (motor_get_active() & _drive_motors)
+        _win_moving = 1;
+
+    if (++_win_n < GYRO_WINDOW)
+        return;
+
+    int32_t mean = _win_sum / GYRO_WINDOW;
+    int32_t mean_q2 = (_win_sum_lsb * 4) / GYRO_WINDOW;
+    int32_t var = (int32_t)((_win_sq << 4) / GYRO_WINDOW) - mean_q2 * mean_q2;
+    _variance_q4 = var < 0 ? 0 : (var > 0xFFFF ? 0xFFFF : var);
+
+    uint8_t still;
+    if (_hint == GYRO_HINT_STATIONARY)
+        still = 1;
+    else if (_hint == GYRO_HINT_MOVING)
+        still = 0;
+    else
+        // let one window go by after the motors stop, for the robot to settle
+        still = !_win_moving && _idle_windows &&
+            _variance_q4 < GYRO_STILL_VAR_Q4 &&
+            mean < GYRO_STILL_RATE_Q6 && mean > -GYRO_STILL_RATE_Q6;
+
+    if (still)
+        _offset_q6 += mean >> GYRO_BIAS_SHIFT;
+    _stationary = still;
+
+    if (_win_moving)
+        _idle_windows = 0;
+    else if (_idle_windows < 255)
+        _idle_windows++;
+
+    _win_sum = 0;
+    _win_sum_lsb = 0;
+    _win_sq = 0;
+    _win_n = 0;
+    _win_moving = 0;
+}
+
+#define GYRO_BARRIER() asm volatile("" ::: "memory")
+
+// sampler callback, runs in interrupt context
+static void gyro_sample(uint8_t ch, uint16_t value, uint32_t time_us) {
+    if (_calibrating) {
+        _cal_sum += value;
+        _cal_samples++;
+        return;
+    }
+
+    int32_t rate = ((int32_t)value << 6) - _offset_q6;
+
+    if (_primed) {
+        uint32_t dt = time_us - _last_time_us;
+        int64_t area;
+
+        // trapezoid; |rate| < 2^17, so 32 bits are enough for short steps
+        if (dt < 16000)
+            area = ((_last_rate + rate) * (int32_t)dt) >> 1;
+        else
+            area = ((int64_t)(_last_rate + rate) * dt) >> 1;
+
+        /* CCW gyro output polarity is negative when the gyro is visible
+           from the top of the robot. */
+        _theta_seq++;
+        GYRO_BARRIER();
+        _theta -= area;
+        GYRO_BARRIER();
+        _theta_seq++;
+
+        _stats.samples++;
+        _dt_sum_us += dt;
+        if (dt < _stats.dt_min_us)
+            _stats.dt_min_us = dt;
+        if (dt > _stats.dt_max_us)
+            _stats.dt_max_us = dt > 0xFFFF ? 0xFFFF : dt;
+    }
+
+    _last_rate = rate;
+    _last_time_us = time_us;
+    _primed = 1;
+
+    gyro_track_bias(rate);
+}
+
+static int64_t gyro_get_theta(void) {
+    uint8_t seq;
+    int64_t theta;
+
+    do {
+        seq = _theta_seq;
+        GYRO_BARRIER();
+        theta = _theta;
+        GYRO_BARRIER();
+    } while ((seq & 1) || seq != _theta_seq);
+
+    return theta;
+}
 #else
 #include <joyos.h>
 #include <stdio.h>
@@ -42,82 +186,46 @@ struct lock gyro_lock;
 
 void gyro_init(uint8_t port, float lsb_us_per_deg, uint32_t time_ms) {
 	#ifndef SIMULATE
-    uint32_t samples;
-    uint32_t sum;
-    uint32_t start_time_ms;
-
-    _port = port;
+    _channel = analog_port_channel(port);
     _lsb_us_per_deg = lsb_us_per_deg;
 
     // average some samples for offset
-    sum = 0.0;
-    samples = 0;
-    start_time_ms = get_time ();
-    while ( (get_time() - start_time_ms) < time_ms ) {
-        sum += analog_read (_port);
-        samples ++;
+    {
+        ATOMIC_BEGIN;
+        _primed = 0;
+        _win_n = 0;
+        _win_sum = 0;
+        _win_sum_lsb = 0;
+        _win_sq = 0;
+        _win_moving = 0;
+        _idle_windows = 0;
+        _cal_sum = 0;
+        _cal_samples = 0;
+        _calibrating = 1;
+        ATOMIC_END;
     }
 
-    _offset = (uint16_t)(sum / samples);
-    _offset_fix = (sum % samples);
-    _fix_divisor = samples;
+    sampler_set_callback(_channel, gyro_sample);
+    sampler_enable(_channel, GYRO_PERIOD_MS);
+    pause(time_ms);
+
+    ATOMIC_BEGIN;
+    if (_cal_samples)
+        _offset_q6 = (((int64_t)_cal_sum << 6) + _cal_samples/2) / _cal_samples;
+    _theta_seq++;
     _theta = 0;
+    _theta_seq++;
+    _calibrating = 0;
+    ATOMIC_END;
 
-    init_lock (&gyro_lock, "gyro lock");
-    create_thread (&gyro_update, STACK_DEFAULT, 0, "gyro");
+    gyro_reset_stats();
 	#endif
 }
 
-#ifndef SIMULATE
-int gyro_update(void) {
-    /* The units of theta are converter LSBs * ms
-       1 deg/s = 5mV = 0.256 LSB for ADXRS300, 12.5mV = 0.64LSB for ADXRS150
-       1 deg = 0.256LSB * 1000ms = 256 (stored in lsb_ms_per_deg)
-       To convert theta to degrees, divide by lsb_ms_per_deg. */
-
-    uint32_t delta_t_us, new_time_us, time_us;
-    int32_t analog_value, fix_value;
-
-    time_us = get_time_us();
-
-    for(;;) {
-        analog_value = (int32_t)analog_read(_port) - _offset;
-        new_time_us = get_time_us();
-        delta_t_us = (new_time_us - time_us);
-        int32_t dtheta = analog_value * delta_t_us;
-
-        fix_value = _offset_fix * delta_t_us;
-
-        /* This does the Riemann sum; CCW gyro output polarity is negative
-           when the gyro is visible from the top of the robot. */
-        acquire (&gyro_lock);
-        // accumulate fractional error
-        _theta_fix += fix_value;
-        // apply error correction
-        // negative because _offset is subtracted
-        // from dtheta
-        dtheta -= _theta_fix / _fix_divisor;
-        _theta_fix %= _fix_divisor;
-        // integrate angle
-        _theta -= dtheta;
-        release (&gyro_lock);
-
-        time_us = new_time_us;
-        yield();
-    }
-
-    return 0;
-}
-#endif
-
 float gyro_get_degrees (void) {
 	#ifndef SIMULATE
 
-    acquire (&gyro_lock);
-    float result = _theta / _lsb_us_per_deg;
-    release (&gyro_lock);
-
-    return result;
+    return gyro_get_theta() / (_lsb_us_per_deg * 64.0);
 
 	#else
 
@@ -136,9 +244,62 @@ float gyro_get_degrees (void) {
 
 #ifndef SIMULATE
 void gyro_set_degrees (float deg) {
-    acquire (&gyro_lock);
-    _theta = deg * _lsb_us_per_deg;
-    release (&gyro_lock);
+    int64_t theta = deg * _lsb_us_per_deg * 64.0;
+
+    ATOMIC_BEGIN;
+    _theta_seq++;
+    _theta = theta;
+    _theta_seq++;
+    ATOMIC_END;
 }
-#endif
 
+int32_t gyro_get_degrees_q8 (void) {
+    return (int32_t)(gyro_get_theta() * 4 / _lsb_us_per_deg);
+}
+
+void gyro_get_stats (struct gyro_stats *stats) {
+    ATOMIC_BEGIN;
+    *stats = _stats;
+    uint32_t dt_sum = _dt_sum_us;
+    ATOMIC_END;
+
+    stats->dt_avg_us = stats->samples ? dt_sum / stats->samples : 0;
+}
+
+void gyro_set_hint (uint8_t hint) {
+    _hint = hint;
+}
+
+void gyro_set_drive_motors (uint8_t mask) {
+    _drive_motors = mask;
+}
+
+float gyro_get_bias (void) {
+    ATOMIC_BEGIN;
+    int32_t offset = _offset_q6;
+    ATOMIC_END;
+
+    return offset / 64.0;
+}
+
+uint16_t gyro_get_variance_q4 (void) {
+    ATOMIC_BEGIN;
+    uint16_t v = _variance_q4;
+    ATOMIC_END;
+
+    return v;
+}
+
+uint8_t gyro_is_stationary (void) {
+    return _stationary;
+}
+
+void gyro_reset_stats (void) {
+    ATOMIC_BEGIN;
+    _stats.samples = 0;
+    _stats.dt_min_us = 0xFFFF;
+    _stats.dt_max_us = 0;
+    _dt_sum_us = 0;
+    ATOMIC_END;
+}
+#endif
@@ -31,6 +31,7 @@
 #include <kern/lock.h>
 #include <kern/thread.h>
 #ifndef SIMULATE
+#include <kern/periodic.h>
 #include <avr/pgmspace.h>
 #else
 #include <stdarg.h>
@@ -100,11 +101,28 @@ unsigned char dlData[] PROGMEM = {
     0x00, 0x0E, 0x0E, 0x0E, 0x1F, 0x0E, 0x04, 0x00
 }; // bootloader
 
+// the refresh task pushes one nibble per period
+#define LCD_REFRESH_PERIOD  1
+
 uint8_t lcdPos = 0;
 uint8_t lcdPosActual = 0;
 uint8_t lcdClearFlag = 0;
 
+// framebuffer: what should be on the display
 char lcdContents[0x20];
+// what is on the display
+static char lcdShown[0x20];
+static volatile uint8_t lcdDirty = 0;
+
+// byte being sent by the refresh task
+static uint8_t lcdRefreshPhase = 0;     // next nibble step, 0 = idle
+static uint8_t lcdRefreshIsData;
+static uint8_t lcdRefreshByte;
+static uint8_t lcdRefreshCell;
+
+static struct periodic_task lcd_task;
+
+extern struct thread *current_thread;
 
 // setup LCD file descriptor (for printf)
 // NOTE: when printing directly to lcdout, lcd_lock should be held
@@ -117,8 +135,20 @@ struct lock lcd_lock;
 
 #ifndef SIMULATE
 
+static uint8_t lcd_refresh_step(void);
+
+// complete the byte the refresh task is part way through, so a direct
+// write doesn't split its nibbles; call with lcd_lock held
+static void lcd_refresh_finish(void) {
+    while (lcdRefreshPhase) {
+        lcd_refresh_step();
+        lcd_wait();
+    }
+}
+
 void lcd_write(uint8_t is_data, uint8_t value) {
     acquire(&lcd_lock);
+    lcd_refresh_finish();
     // set data/ctrl
     LCD_RS(is_data);
     // write high nibble
@@ -135,17 +165,110 @@ void lcd_write(uint8_t is_data, uint8_t value) {
     lcd_wait();
     LCD_E(0);
     lcd_wait();
+    // the address counter may have moved
+    lcdPosActual = 0xFF;
+    release(&lcd_lock);
+}
+
+// put a nibble on the bus with E high
+static void lcd_nibble(uint8_t is_data, uint8_t nibble) {
+    if (is_data) PORTD = (PORTD & 0x03) | (nibble<<2) | _BV(LCD_PIN_E) | _BV(LCD_PIN_RS);
+    else PORTD = (PORTD & 0x03) | (nibble<<2) | _BV(LCD_PIN_E);
+}
+
+// choose the next byte to send, returns 0 if the display is up to date
+static uint8_t lcd_refresh_next(void) {
+    if (!lcdDirty)
+        return 0;
+
+    for (uint8_t i = 0; i < 0x20; i++) {
+        // scan from the display's cursor, so runs of changes need no moves
+        uint8_t c = (lcdPosActual < 0x20 ? lcdPosActual + i : i) & 0x1F;
+        if (lcdContents[c] == lcdShown[c])
+            continue;
+
+        lcdRefreshCell = c;
+        if (c != lcdPosActual) {
+            lcdRefreshIsData = LCD_CTRL;
+            lcdRefreshByte = LCD_DDADDR | (c<16 ? c : c+0x30);
+        } else {
+            lcdRefreshIsData = LCD_DATA;
+            lcdRefreshByte = lcdContents[c];
+        }
+        return 1;
+    }
+
+    lcdDirty = 0;
+    return 0;
+}
+
+// advance the refresh by one nibble step; returns 0 once the display is up
+// to date. Call with lcd_lock held, at least 40us apart.
+static uint8_t lcd_refresh_step(void) {
+    if (lcdRefreshPhase == 0 && !lcd_refresh_next())
+        return 0;
+
+    switch (lcdRefreshPhase) {
+        case 0:
+            LCD_RS(lcdRefreshIsData);
+            lcd_nibble(lcdRefreshIsData, NIBBLE_HI(lcdRefreshByte));
+            break;
+        case 2:
+            lcd_nibble(lcdRefreshIsData, NIBBLE_LO(lcdRefreshByte));
+            break;
+        case 1:
+            LCD_E(0);
+            break;
+        case 3:
+            LCD_E(0);
+            if (lcdRefreshIsData) {
+                lcdShown[lcdRefreshCell] = lcdRefreshByte;
+                lcdPosActual++;
+                // the second line is not contiguous in DDRAM
+                if (lcdPosActual == 0x10)
+                    lcdPosActual = 0xFF;
+            } else {
+                lcdPosActual = lcdRefreshCell;
+            }
+            break;
+    }
+    lcdRefreshPhase = (lcdRefreshPhase + 1) & 3;
+    return 1;
+}
+
+static void lcd_refresh(void *arg) {
+    // don't hold up the other periodic tasks behind a long printf
+    if (!try_acquire(&lcd_lock))
+        return;
+    lcd_refresh_step();
     release(&lcd_lock);
 }
 
+void lcd_flush(void) {
+    acquire(&lcd_lock);
+    while (lcd_refresh_step()) {
+        lcd_wait();
+    }
+    release(&lcd_lock);
+}
+
+// without a running scheduler (boot, panic) the refresh task can't run
+static void lcd_sync(void) {
+    if (!current_thread || !(SREG & SREG_IF))
+        lcd_flush();
+}
+
 void lcd_set_custom_char(uint8_t chnum,uint8_t *data) {
     acquire(&lcd_lock);
+    lcd_refresh_finish();
     uint8_t i;
     chnum <<= 3;
     for(i=0; i<8; i++) {
         lcd_write(LCD_CTRL, LCD_CGADDR|(chnum+i));
         lcd_write(LCD_DATA, pgm_read_byte(data+i));
     }
+    // the address counter is in CGRAM now
+    lcdPosActual = 0xFF;
     release(&lcd_lock);
 }
 
@@ -166,31 +289,33 @@ void lcd_init(void) {
     lcd_set_custom_char(6,(uint8_t*)dlData);
     lcd_write(LCD_CTRL, LCD_CLR); // 0x01
     lcd_write(LCD_CTRL, LCD_HOME); // 0x02
-    for(i=0;i<0x20;i++)
+    for(i=0;i<0x20;i++) {
         lcdContents[i] = ' ';
+        lcdShown[i] = ' ';
+    }
+    lcdPosActual = 0;
     lcd_write(LCD_CTRL, LCD_ENTRYMODE | LCD_CURSINC); // 0x06
     lcd_write(LCD_CTRL, LCD_DISPCTL | LCD_DISPON); // 0x0C
 
     init_lock(&lcd_lock, "LCD lock");
+    periodic_add(&lcd_task, lcd_refresh, NULL, LCD_REFRESH_PERIOD);
 }
 
 // apparently used only in bootloader, and there only for printable characters
 void lcd_print(const char *string) {
     acquire(&lcd_lock);
-    uint8_t i=0;
     while (*string) {
         if (*string=='\n') {
-            lcd_write(LCD_CTRL, LCD_DDADDR);
             lcdPos=0;
+        } else {
+            if (lcdPos == 0x20)
+                lcdPos = 0;
+            lcdContents[lcdPos++] = *string;
+            lcdDirty = 1;
         }
-        else
-            lcd_write(LCD_DATA, *string);
-        if (i==15)
-            lcd_write(LCD_CTRL, LCD_DDADDR|0x40);
-        i++;
-        lcdPos++;
         string++;
     }
+    lcd_sync();
     release(&lcd_lock);
 }
 
@@ -264,16 +389,12 @@ int lcd_print_char(char ch, FILE *f) {
     if (ch=='\n')
         lcdClearFlag = 1;
     else {
-        if (lcdPos == 0x10)
-            lcdPosActual = 0xFF;
         if (lcdContents[lcdPos] != ch) {
             lcdContents[lcdPos] = ch;
-            if (lcdPosActual != lcdPos)
-                lcd_set_pos(lcdPos);
-            lcd_write(LCD_DATA, ch);
-            lcdPosActual++;
+            lcdDirty = 1;
         }
         lcdPos++;
+        lcd_sync();
     }
 
     // give up control
@@ -289,25 +410,20 @@ uint8_t lcd_get_pos(void) {
 void lcd_set_pos(uint8_t p) {
     acquire(&lcd_lock);
     lcdPos = p;
-    if (p != lcdPosActual) {
-        lcdPosActual = p;
-        if (p<16)
-            lcd_write(LCD_CTRL, LCD_DDADDR|p);
-        else
-            lcd_write(LCD_CTRL, LCD_DDADDR|(p+0x30));
-    }
     release(&lcd_lock);
 }
 
 void lcd_clear(void) {
     int i;
     acquire(&lcd_lock);
-    lcd_write(LCD_CTRL, LCD_CLR);
-    lcd_write(LCD_CTRL, LCD_HOME);
-    for(i=0;i<0x20;i++)
-        lcdContents[i] = ' ';
+    for(i=0;i<0x20;i++) {
+        if (lcdContents[i] != ' ') {
+            lcdContents[i] = ' ';
+            lcdDirty = 1;
+        }
+    }
     lcdPos = 0;
-    lcdPosActual = 0;
+    lcd_sync();
     release(&lcd_lock);
 }
 
@@ -24,9 +24,13 @@
  */
 
 #include <config.h>
+#include <motor.h>
 #ifndef SIMULATE
 #include <fpga.h>
 #include <mcp3008.h>
+#include <sampler.h>
+#include <kern/periodic.h>
+#include <buttons.h>
 #else
 #include <socket.h>
 #include <stdint.h>
@@ -43,26 +47,177 @@
 
 #define MOTOR_MA_PER_LSB    16.11
 
+// monitor timing: a stall is reported after MOTOR_STALL_SAMPLES samples
+// over the threshold, i.e. 40ms
+#define MOTOR_MONITOR_PERIOD    5
+#define MOTOR_STALL_SAMPLES     8
+
+// PWM derating, as a fraction of MOTOR_DERATE_FULL
+#define MOTOR_DERATE_FULL       256
+#define MOTOR_DERATE_MIN        64
+#define MOTOR_DERATE_DOWN       32
+#define MOTOR_DERATE_UP         8
+
+// battery compensation, as a fraction of MOTOR_DERATE_FULL, 0.75x to 1.5x
+#define MOTOR_COMP_MIN          192
+#define MOTOR_COMP_MAX          384
+
 struct lock motor_lock;
 
+#ifndef SIMULATE
+// bit n set if motor n was last given a non-zero velocity
+static volatile uint8_t motor_active = 0;
+
+// last values written to the FPGA; 0xFF forces the next write
+static uint8_t motor_ctl_shadow[6];
+static uint8_t motor_vel_shadow[6];
+
+// current monitor state
+static struct periodic_task motor_monitor_task;
+static int16_t motor_req[6];            // velocity asked for, before derating
+static uint16_t motor_derate[6];
+static uint16_t motor_nominal_mv = 0;   // 0 = no battery compensation
+static uint16_t motor_comp = MOTOR_DERATE_FULL;
+static uint16_t motor_stall_lsb[6];     // 0 = no stall detection
+static uint16_t motor_limit_lsb[6];     // 0 = no current limit
+static uint8_t motor_stall_count[6];
+static volatile uint8_t motor_stalled = 0;
+static motor_stall_handler motor_stall_handlers[MOTOR_STALL_HANDLERS];
+
+// write a motor's registers, skipping those that would not change.
+// Call with motor_lock held.
+static void motor_write(uint8_t motor, uint8_t ctl, uint8_t vel) {
+    uint8_t mbase = FPGA_MOTOR_BASE + motor*FPGA_MOTOR_SIZE;
+    if (motor_ctl_shadow[motor] != ctl) {
+        fpga_write_byte(mbase+FPGA_MOTOR_CTL, ctl);
+        motor_ctl_shadow[motor] = ctl;
+    }
+    if (motor_vel_shadow[motor] != vel) {
+        fpga_write_byte(mbase+FPGA_MOTOR_VEL, vel);
+        motor_vel_shadow[motor] = vel;
+    }
+    if (ctl == MOTOR_CTL_FWD || ctl == MOTOR_CTL_REV)
+        motor_active |= (1 << motor);
+    else
+        motor_active &= ~(1 << motor);
+}
+
+static void motor_write_vel(uint8_t motor, int16_t vel) {
+    motor_req[motor] = vel;
+    int32_t out = (int32_t)vel * motor_derate[motor] / MOTOR_DERATE_FULL;
+    out = out * motor_comp / MOTOR_DERATE_FULL;
+    if (out > 255)
+        out = 255;
+    else if (out < -255)
+        out = -255;
+    if (vel>0)
+        motor_write(motor, MOTOR_CTL_FWD, out);
+    else if (vel<0)
+        motor_write(motor, MOTOR_CTL_REV, -out);
+    else
+        motor_write(motor, MOTOR_CTL_COAST, 0);
+}
+
+static void motor_monitor(void *arg) {
+    uint8_t changed = 0;
+
+    acquire(&motor_lock);
+    uint8_t active = motor_active;
+
+    // scale by nominal/actual battery voltage
+    uint16_t comp = MOTOR_DERATE_FULL;
+    if (motor_nominal_mv) {
+        uint16_t mv = read_battery_filtered();
+        if (mv) {
+            uint32_t c = (uint32_t)motor_nominal_mv * MOTOR_DERATE_FULL / mv;
+            if (c < MOTOR_COMP_MIN)
+                c = MOTOR_COMP_MIN;
+            else if (c > MOTOR_COMP_MAX)
+                c = MOTOR_COMP_MAX;
+            comp = c;
+        }
+    }
+    uint8_t comp_changed = (comp != motor_comp);
+    motor_comp = comp;
+
+    for (uint8_t i = 0; i < 6; i++) {
+        uint8_t bit = 1 << i;
+
+        if (!(active & bit)) {
+            motor_stall_count[i] = 0;
+            motor_derate[i] = MOTOR_DERATE_FULL;
+            if (motor_stalled & bit) {
+                motor_stalled &= ~bit;
+                changed |= bit;
+            }
+            continue;
+        }
+
+        uint16_t current = motor_get_current(i);
+
+        if (motor_stall_lsb[i] && current >= motor_stall_lsb[i]) {
+            if (motor_stall_count[i] < MOTOR_STALL_SAMPLES &&
+                    ++motor_stall_count[i] == MOTOR_STALL_SAMPLES) {
+                motor_stalled |= bit;
+                changed |= bit;
+            }
+        } else {
+            motor_stall_count[i] = 0;
+            if (motor_stalled & bit) {
+                motor_stalled &= ~bit;
+                changed |= bit;
+            }
+        }
+
+        // back off quickly while over the limit, recover slowly
+        uint16_t derate = motor_derate[i];
+        if (motor_limit_lsb[i] && current > motor_limit_lsb[i]) {
+            if (derate > MOTOR_DERATE_MIN + MOTOR_DERATE_DOWN)
+                derate -= MOTOR_DERATE_DOWN;
+            else
+                derate = MOTOR_DERATE_MIN;
+        } else if (derate < MOTOR_DERATE_FULL) {
+            derate += MOTOR_DERATE_UP;
+            if (derate > MOTOR_DERATE_FULL)
+                derate = MOTOR_DERATE_FULL;
+        }
+        if (derate != motor_derate[i] || comp_changed) {
+            motor_derate[i] = derate;
+            motor_write_vel(i, motor_req[i]);
+        }
+    }
+    uint8_t stalled = motor_stalled;
+    release(&motor_lock);
+
+    // tell subscribers outside the lock, so they can set motors
+    for (uint8_t i = 0; i < 6; i++) {
+        if (!(changed & (1 << i)))
+            continue;
+        for (uint8_t h = 0; h < MOTOR_STALL_HANDLERS; h++) {
+            if (motor_stall_handlers[h])
+                motor_stall_handlers[h](i, (stalled >> i) & 1);
+        }
+    }
+}
+#endif
+
 void motor_init (void) {
 	#ifndef SIMULATE
     init_lock(&motor_lock, "motor lock");
+    for (uint8_t i = 0; i < 6; i++) {
+        motor_ctl_shadow[i] = 0xFF;
+        motor_vel_shadow[i] = 0xFF;
+        motor_derate[i] = MOTOR_DERATE_FULL;
+        motor_stall_lsb[i] = MOTOR_STALL_DEFAULT_MA / MOTOR_MA_PER_LSB;
+    }
+    periodic_add(&motor_monitor_task, motor_monitor, NULL, MOTOR_MONITOR_PERIOD);
 	#endif
 }
 
 void motor_set_vel(uint8_t motor, int16_t vel) {
 	#ifndef SIMULATE
     acquire(&motor_lock);
-    uint8_t mbase = FPGA_MOTOR_BASE + motor*FPGA_MOTOR_SIZE;
-    if (vel>0)
-        fpga_write_byte(mbase+FPGA_MOTOR_CTL, MOTOR_CTL_FWD);
-    else if (vel<0)
-        fpga_write_byte(mbase+FPGA_MOTOR_CTL, MOTOR_CTL_REV);
-    else
-        fpga_write_byte(mbase+FPGA_MOTOR_CTL, MOTOR_CTL_COAST);
-
-    fpga_write_byte(mbase+FPGA_MOTOR_VEL,abs(vel));
+    motor_write_vel(motor, vel);
     release(&motor_lock);
 	#else
 
@@ -74,11 +229,34 @@ void motor_set_vel(uint8_t motor, int16_t vel) {
 	#endif
 }
 
+void motor_set_vels(uint8_t mask, const int16_t *vels) {
+	#ifndef SIMULATE
+    acquire(&motor_lock);
+    // older FPGA images ignore the hold register, and the writes just take
+    // effect one at a time
+    fpga_write_byte(FPGA_MOTOR_HOLD, 1);
+    for (uint8_t i = 0; i < 6; i++) {
+        if (mask & (1 << i))
+            motor_write_vel(i, vels[i]);
+    }
+    fpga_write_byte(FPGA_MOTOR_HOLD, 0);
+    release(&motor_lock);
+	#else
+    for (uint8_t i = 0; i < 6; i++) {
+        if (mask & (1 << i))
+            motor_set_vel(i, vels[i]);
+    }
+	#endif
+}
+
 void motor_brake(uint8_t motor) {
 	#ifndef SIMULATE
     acquire(&motor_lock);
-    uint8_t mbase = FPGA_MOTOR_BASE + motor*FPGA_MOTOR_SIZE;
-    fpga_write_byte(mbase+FPGA_MOTOR_CTL, MOTOR_CTL_BRAKE);
+    // never leave a brake sitting in the shadow registers
+    fpga_write_byte(FPGA_MOTOR_HOLD, 0);
+    // keep the velocity, as before; braking ignores it
+    motor_req[motor] = 0;
+    motor_write(motor, MOTOR_CTL_BRAKE, motor_vel_shadow[motor]);
     release(&motor_lock);
 	#else
 	motor_set_vel(motor, 0);
@@ -87,16 +265,50 @@ void motor_brake(uint8_t motor) {
 
 #ifndef SIMULATE
 uint16_t motor_get_current(uint8_t motor) {
-    acquire(&motor_lock);
     uint8_t adcPortMap[6] = {4,5,2,3,0,1};
-    uint16_t v;
-    mcp3008_get_sample(MCP3008_MOTOR, MCP3008_CH0+adcPortMap[motor],&v);
-    release(&motor_lock);
-    return v;
+    return sampler_read(SAMPLER_CHANNEL(MCP3008_MOTOR, adcPortMap[motor]));
+}
+
+uint8_t motor_get_active(void) {
+    return motor_active;
 }
 
 uint16_t motor_get_current_MA(uint8_t motor) {
     return motor_get_current(motor)*MOTOR_MA_PER_LSB;
 }
-#endif
+void motor_set_stall_current(uint8_t motor, uint16_t ma) {
+    acquire(&motor_lock);
+    motor_stall_lsb[motor] = ma / MOTOR_MA_PER_LSB;
+    release(&motor_lock);
+}
+
+void motor_set_current_limit(uint8_t motor, uint16_t ma) {
+    acquire(&motor_lock);
+    motor_limit_lsb[motor] = ma / MOTOR_MA_PER_LSB;
+    release(&motor_lock);
+}
+
+void motor_set_battery_compensation(uint16_t nominal_mv) {
+    acquire(&motor_lock);
+    motor_nominal_mv = nominal_mv;
+    release(&motor_lock);
+}
+
+uint8_t motor_get_stalled(void) {
+    return motor_stalled;
+}
 
+int8_t motor_stall_subscribe(motor_stall_handler handler) {
+    int8_t ret = -1;
+    acquire(&motor_lock);
+    for (uint8_t h = 0; h < MOTOR_STALL_HANDLERS; h++) {
+        if (!motor_stall_handlers[h]) {
+            motor_stall_handlers[h] = handler;
+            ret = 0;
+            break;
+        }
+    }
+    release(&motor_lock);
+    return ret;
+}
+#endif
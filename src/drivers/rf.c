@@ -10,6 +10,7 @@
 #include <kern/thread.h>
 #include <kern/lock.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 #include <rf.h>
 #include <hal/spi.h>
 #include <hal/io.h>
@@ -25,11 +26,25 @@
 
 #endif
 
-struct lock objects_lock;
 volatile game_data game;
-volatile game_data locked_game;
 volatile uint32_t position_microtime;
-volatile uint32_t locked_position_microtime;
+
+#ifndef SIMULATE
+
+// Latest game data from the VPS, written only by the RF thread. game_seq is
+// odd while an update is in progress; readers copy and retry if it changed,
+// so they never hold up the writer.
+static volatile game_data locked_game;
+static volatile uint32_t locked_position_microtime;
+static volatile uint8_t game_seq = 0;
+// arrival time (get_time()) and count of the packets that carried our own
+// position; the count skips 0, which means no fix yet
+static volatile uint32_t locked_fix_time;
+static volatile uint8_t locked_fix_count = 0;
+// memcpy casts away volatile, so keep it between the game_seq updates
+#define GAME_BARRIER() asm volatile("" ::: "memory")
+
+#endif
 
 #ifndef SIMULATE
 
@@ -47,6 +62,71 @@ volatile uint8_t rf_new_str;
 struct lock rf_lock;
 volatile uint8_t robot_id = 0xFF;
 
+// the nRF IRQ line (active low) is on PE7 / INT7
+#define RF_IRQ_ASSERTED()   (!(PINE & _BV(7)))
+// check the radio this often even without an interrupt, in case an edge
+// was missed, in milliseconds
+#define RF_IRQ_TIMEOUT      100
+
+static volatile uint8_t rf_irq_pending = 0;
+
+// link statistics, per source board
+static struct rf_link_stats rf_stats[RF_SOURCES];
+static uint8_t rf_last_seq[RF_SOURCES];
+static uint32_t rf_last_time[RF_SOURCES];
+static uint16_t rf_oversize = 0;
+static uint16_t rf_tx_failures = 0;
+
+extern struct thread *current_thread;
+
+// packets waiting to be sent by the RF thread
+struct rf_tx_entry {
+    uint8_t address;
+    uint8_t len;
+    uint8_t data[sizeof(packet_buffer)];
+};
+
+static struct rf_tx_entry rf_tx_queue[RF_TX_QUEUE_SIZE];
+static volatile uint8_t rf_tx_head = 0;
+static volatile uint8_t rf_tx_tail = 0;
+static struct thread *rf_thread = NULL;
+
+// held while the radio is out of receive mode
+static struct lock rf_radio_lock;
+
+// only RX_DR is unmasked in receive mode, so the line going low means a
+// packet has arrived
+ISR(INT7_vect) {
+    rf_irq_pending = 1;
+    thread_wakeup((void *)&rf_irq_pending);
+}
+
+int8_t rf_queue_packet(uint8_t address, uint8_t *data, uint8_t len) {
+    int8_t ret = -1;
+
+    if (len > sizeof(packet_buffer))
+        return -1;
+
+    ATOMIC_BEGIN;
+    // wait for room, unless the RF thread itself (or the kernel) is sending
+    while ((uint8_t)(rf_tx_head - rf_tx_tail) == RF_TX_QUEUE_SIZE &&
+            current_thread && current_thread != rf_thread)
+        thread_sleep(rf_tx_queue);
+
+    if ((uint8_t)(rf_tx_head - rf_tx_tail) < RF_TX_QUEUE_SIZE) {
+        struct rf_tx_entry *e = &rf_tx_queue[rf_tx_head & (RF_TX_QUEUE_SIZE-1)];
+        e->address = address;
+        e->len = len;
+        memcpy(e->data, data, len);
+        rf_tx_head++;
+        thread_wakeup((void *)&rf_irq_pending);
+        ret = 0;
+    }
+    ATOMIC_END;
+
+    return ret;
+}
+
 int rf_send(char ch){
     ATOMIC_BEGIN;
 
@@ -54,7 +134,7 @@ int rf_send(char ch){
 
     if ((ch=='\n') || (rf_ch_count == PAYLOAD_SIZE)){
         tx.type = STRING;
-        rf_send_packet(0xE7, (uint8_t*)(&tx), sizeof(packet_buffer));
+        rf_queue_packet(0xE7, (uint8_t*)(&tx), sizeof(packet_buffer));
         rf_ch_count = 0;
     }
 
@@ -182,64 +262,107 @@ uint8_t rf_has_char() {
         (rf_str_buf[rf_buf_index] != '\0');
 }
 
-void rf_rx(void) {
+// radio settings, applied by rf_configure(); the defaults match the VPS
+// base stations
+static uint8_t rf_channel = 2;
+static uint8_t rf_data_rate = NRF_RF_DR_1MBPS;
+static uint8_t rf_dynamic_payload = 0;
+static uint8_t rf_retries = 0;
+
+// CONFIG for each mode. Only PRIM_RX and the interrupt masks differ, so a
+// turnaround is a single register write.
+static uint8_t rf_config_rx;
+static uint8_t rf_config_tx;
+
+// write the whole configuration, leaving the radio powered up in standby;
+// call with rf_radio_lock held
+static void rf_configure(void) {
+    // 8 bit CRC: the old setup asked for 16 bits, but its final CONFIG
+    // write left CRCO clear, and the base stations expect that
+    uint8_t crc = _BV(NRF_BIT_EN_CRC);
+
+    rf_config_rx = crc | _BV(NRF_BIT_PWR_UP) | _BV(NRF_BIT_PRIM_RX) |
+        _BV(NRF_BIT_MASK_MAX_RT) | _BV(NRF_BIT_MASK_TX_DR);
+    rf_config_tx = crc | _BV(NRF_BIT_PWR_UP) |
+        _BV(NRF_BIT_MASK_MAX_RT) | _BV(NRF_BIT_MASK_TX_DR) | _BV(NRF_BIT_MASK_RX_DR);
+
     RF_CE(0);
-    delay_busy_us(150); // I don't think delay_busy_us actually goes up that high
-    nrf_write_reg(NRF_REG_CONFIG,
-            _BV(NRF_BIT_PRIM_RX) |
-            _BV(NRF_BIT_CRCO) |
-            _BV(NRF_BIT_EN_CRC) |
-            _BV(NRF_BIT_MASK_MAX_RT) |
-            _BV(NRF_BIT_MASK_TX_DR)); // PRX, 16 bit CRC enabled
-    nrf_write_reg(NRF_REG_EN_AA, 0); // disable auto-ack for all channels
+    nrf_begin();
+    nrf_write_reg(NRF_REG_CONFIG, rf_config_tx);
+    // auto-ack needs pipe 0 to receive the ACKs to our transmissions, and
+    // the radio only honours DPL on a pipe with auto-ack enabled
+    nrf_write_reg(NRF_REG_EN_AA,
+            (rf_retries || rf_dynamic_payload) ? _BV(NRF_BIT_ENAA_P0) : 0);
+    // retry every 500us
+    nrf_write_reg(NRF_REG_SETUP_RETR,
+            rf_retries ? (1 << NRF_RETR_ARD_BASE) | (rf_retries << NRF_RETR_ARC_BASE) : 0);
+    nrf_write_reg(NRF_REG_SETUP_AW, NRF_AW_5);
     nrf_write_reg(NRF_REG_RF_SETUP,
             (NRF_RF_PWR_0DB << NRF_RF_PWR_BASE) |
-            (NRF_RF_DR_1MBPS << NRF_BIT_RF_DR_BASE) |
-            _BV(NRF_BIT_LNA_HCURR)); // data rate = 1MB
+            (rf_data_rate << NRF_BIT_RF_DR_BASE) |
+            _BV(NRF_BIT_LNA_HCURR));
+    nrf_write_reg(NRF_REG_RF_CH, rf_channel);
+    uint8_t addr[5] = {0xE7, 0xE7, 0xE7, 0xE7, 0xE7};
+    nrf_write_multibyte_reg(NRF_REG_TX_ADDR, addr, 5);
     nrf_write_reg(NRF_REG_RX_PW_P0, sizeof(packet_buffer));
-    nrf_write_reg(NRF_REG_CONFIG,
-            _BV(NRF_BIT_PRIM_RX) |
-            _BV(NRF_BIT_PWR_UP) |
-            //_BV(NRF_BIT_CRCO) | // this bit was not in the configuration for some unknown reason
-            _BV(NRF_BIT_EN_CRC) |
-            _BV(NRF_BIT_MASK_MAX_RT) |
-            _BV(NRF_BIT_MASK_TX_DR)); // PWR_UP = 1
+    // FEATURE must be written before DYNPD
+    nrf_write_reg(NRF_REG_FEATURE, rf_dynamic_payload ? _BV(NRF_BIT_EN_DPL) : 0);
+    nrf_write_reg(NRF_REG_DYNPD, rf_dynamic_payload ? _BV(NRF_BIT_DPL_P0) : 0);
+    nrf_flush_rx();
+    nrf_flush_tx();
+    nrf_write_reg(NRF_REG_STATUS, _BV(NRF_BIT_RX_DR) | _BV(NRF_BIT_TX_DS) | _BV(NRF_BIT_MAX_RT));
+    nrf_end();
+    // power up takes 1.5ms
+    delay_busy_ms(2);
+}
+
+void rf_rx(void) {
+    RF_CE(0);
+    nrf_write_reg(NRF_REG_CONFIG, rf_config_rx);
     RF_CE(1);
-    // wait >= 130 us
-    delay_busy_us(150);
+    // wait >= 130 us for the receiver to settle
+    delay_busy_us(130);
 }
 
 uint8_t rf_tx(void) {
+    // standby; the 130us settling happens when CE is pulsed to send
     RF_CE(0);
-    delay_busy_us(150);
-    nrf_write_reg(NRF_REG_CONFIG,
-            _BV(NRF_BIT_CRCO) |
-            _BV(NRF_BIT_EN_CRC) |
-            _BV(NRF_BIT_MASK_MAX_RT) |
-            _BV(NRF_BIT_MASK_TX_DR) |
-            _BV(NRF_BIT_MASK_RX_DR)); //16 bit CRC enabled, be a transmitter
-    nrf_write_reg(NRF_REG_EN_AA, 0); //Disable auto acknowledge on all pipes
-    nrf_write_reg(NRF_REG_SETUP_RETR, 0); //Disable auto-retransmit
-    nrf_write_reg(NRF_REG_SETUP_AW, NRF_AW_5); //Set address width to 5bytes (default, not really needed)
-    nrf_write_reg(NRF_REG_RF_SETUP,
-            (NRF_RF_PWR_0DB << NRF_RF_PWR_BASE) |
-            (NRF_RF_DR_1MBPS << NRF_BIT_RF_DR_BASE) |
-            _BV(NRF_BIT_LNA_HCURR)); //Air data rate 1Mbit, 0dBm, Setup LNA
-    nrf_write_reg(NRF_REG_RF_CH, 2); //RF Channel 2 (default, not really needed)
-    uint8_t addr[5] = {0xE7, 0xE7, 0xE7, 0xE7, 0xE7};
-    nrf_write_multibyte_reg(NRF_REG_TX_ADDR, addr, 5);
-    nrf_write_reg(NRF_REG_CONFIG,
-            _BV(NRF_BIT_PWR_UP) |
-            //_BV(NRF_BIT_CRCO) |
-            _BV(NRF_BIT_EN_CRC) |
-            _BV(NRF_BIT_MASK_MAX_RT) |
-            _BV(NRF_BIT_MASK_TX_DR) |
-            _BV(NRF_BIT_MASK_RX_DR)); //Power up, be a transmitter
-    return nrf_read_status();
+    return nrf_write_reg(NRF_REG_CONFIG, rf_config_tx);
 }
 
-uint8_t rf_send_packet(uint8_t address, uint8_t *data, uint8_t len) {
-    rf_tx();
+// apply changed settings and go back to receiving
+static void rf_reconfigure(void) {
+    acquire(&rf_radio_lock);
+    rf_configure();
+    rf_rx();
+    release(&rf_radio_lock);
+}
+
+void rf_set_channel(uint8_t channel) {
+    if (channel > RF_CHANNEL_MAX)
+        channel = RF_CHANNEL_MAX;
+    rf_channel = channel;
+    rf_reconfigure();
+}
+
+void rf_set_data_rate(uint8_t rate) {
+    rf_data_rate = (rate == RF_RATE_2MBPS) ? NRF_RF_DR_2MBPS : NRF_RF_DR_1MBPS;
+    rf_reconfigure();
+}
+
+void rf_set_dynamic_payload(uint8_t enable) {
+    rf_dynamic_payload = enable ? 1 : 0;
+    rf_reconfigure();
+}
+
+void rf_set_auto_ack(uint8_t retries) {
+    rf_retries = retries > 15 ? 15 : retries;
+    rf_reconfigure();
+}
+
+// send one packet; the radio must already be in transmit mode
+static uint8_t rf_tx_one(uint8_t address, uint8_t *data, uint8_t len) {
+    nrf_begin();
     // preserve pipe 0 address
     uint8_t pipe0_addr = nrf_read_reg(NRF_REG_RX_ADDR_P0);
     // listen for ACK to this address
@@ -250,33 +373,137 @@ uint8_t rf_send_packet(uint8_t address, uint8_t *data, uint8_t len) {
     nrf_write_reg(NRF_REG_STATUS, 0x7E); //Clear any interrupts
 
     nrf_write_tx_payload(data, len);
+    nrf_end();
     // start transmission
     RF_CE(1);
     delay_busy_us(20);
     RF_CE(0);
-    // wait for ACK
+    // wait for ACK, letting go of the bus in between
     uint8_t status;
     while(((status = nrf_read_reg(NRF_REG_STATUS)) & (_BV(NRF_BIT_TX_DS) | _BV(NRF_BIT_MAX_RT))) == 0) {
         yield();
     }
     //printf("TX ACK status: %02X\n", status);
+    nrf_begin();
     // clear transmit interrupt conditions
     nrf_write_reg(NRF_REG_STATUS, status & (_BV(NRF_BIT_TX_DS) | _BV(NRF_BIT_MAX_RT)));
     // restore pipe 0 address
     nrf_write_reg(NRF_REG_RX_ADDR_P0, pipe0_addr);
     // flush TX FIFO
     nrf_flush_tx();
+    nrf_end();
+    if (status & _BV(NRF_BIT_MAX_RT))
+        rf_tx_failures++;
+    return (status & _BV(NRF_BIT_TX_DS)) != 0;
+}
+
+uint8_t rf_send_packet(uint8_t address, uint8_t *data, uint8_t len) {
+    acquire(&rf_radio_lock);
+    rf_tx();
+    uint8_t ok = rf_tx_one(address, data, len);
     // return to RX mode
     rf_rx();
-    return (status & _BV(NRF_BIT_TX_DS)) != 0;
+    release(&rf_radio_lock);
+    return ok;
+}
+
+// send everything queued in one trip out of receive mode
+static void rf_tx_burst(void) {
+    acquire(&rf_radio_lock);
+    rf_tx();
+    while (rf_tx_head != rf_tx_tail) {
+        struct rf_tx_entry *e = &rf_tx_queue[rf_tx_tail & (RF_TX_QUEUE_SIZE-1)];
+        rf_tx_one(e->address, e->data, e->len);
+
+        ATOMIC_BEGIN;
+        rf_tx_tail++;
+        thread_wakeup(rf_tx_queue);
+        ATOMIC_END;
+    }
+    rf_rx();
+    release(&rf_radio_lock);
 }
 
 uint8_t rf_which_board = 0xFF;
+// count a packet from one of the base station boards; packets from other
+// robots (STRING, TELEMETRY) don't carry a board or sequence number
+static void rf_count_packet(packet_buffer *rx) {
+    uint8_t src = rx->board;
+    struct rf_link_stats *st = &rf_stats[src];
+    uint32_t now = get_time();
+
+    ATOMIC_BEGIN;
+    if (st->received) {
+        uint8_t gap = (rx->seq_no - rf_last_seq[src]) & 0x3F;
+        if (gap == 0 || gap >= 0x20) {
+            // repeated, or older than the last one
+            st->duplicates++;
+            ATOMIC_END;
+            return;
+        }
+        st->lost += gap - 1;
+
+        // interval histogram, buckets doubling from RF_INTERVAL_MIN ms
+        uint32_t interval = now - rf_last_time[src];
+        uint8_t b = 0;
+        while (b < RF_INTERVAL_BUCKETS-1 && interval >= ((uint32_t)RF_INTERVAL_MIN << b))
+            b++;
+        if (st->intervals[b] != 0xFFFF)
+            st->intervals[b]++;
+    }
+    st->received++;
+    rf_last_seq[src] = rx->seq_no;
+    rf_last_time[src] = now;
+    ATOMIC_END;
+}
+
+void rf_get_link_stats(uint8_t board, struct rf_link_stats *stats) {
+    ATOMIC_BEGIN;
+    *stats = rf_stats[board & (RF_SOURCES-1)];
+    ATOMIC_END;
+}
+
+uint16_t rf_get_oversize_count(void) {
+    return rf_oversize;
+}
+
+uint16_t rf_get_tx_failures(void) {
+    return rf_tx_failures;
+}
+
+void rf_reset_link_stats(void) {
+    ATOMIC_BEGIN;
+    memset(rf_stats, 0, sizeof(rf_stats));
+    rf_oversize = 0;
+    rf_tx_failures = 0;
+    ATOMIC_END;
+}
+
+int8_t rf_send_link_stats(uint8_t board) {
+    packet_buffer pkt;
+    struct rf_telemetry t;
+    struct rf_link_stats stats;
+
+    rf_get_link_stats(board, &stats);
+    t.stats = stats;
+    t.robot_id = robot_id;
+    t.oversize = rf_oversize;
+    t.tx_failures = rf_tx_failures;
+
+    memset(&pkt, 0, sizeof(pkt));
+    pkt.type = TELEMETRY;
+    pkt.board = board;
+    memcpy(pkt.payload.array, &t, sizeof(t));
+    return rf_queue_packet(0xE7, (uint8_t *)&pkt, sizeof(pkt));
+}
+
 void rf_process_packet (packet_buffer *rx, uint8_t size, uint8_t pipe) {
     uint8_t type = rx->type;
 
+
     switch (type) {
         case POSITION:
+            rf_count_packet(rx);
             if (robot_id != 0xFF) {
                 // if we're in position 1, swap to position 0
                 if (rx->payload.game.coords[1].id == robot_id) {
@@ -289,7 +516,14 @@ void rf_process_packet (packet_buffer *rx, uint8_t size, uint8_t pipe) {
                     rf_which_board = rx->board;
                 // if this packet is for the board we're on, save it
                 if (rf_which_board == rx->board) {
-                    acquire(&objects_lock);
+                    game_seq++;
+                    GAME_BARRIER();
+
+                    if (rx->payload.game.coords[0].id == robot_id) {
+                        locked_fix_time = get_time();
+                        if (++locked_fix_count == 0)
+                            locked_fix_count = 1;
+                    }
 
                     // if this packet doesn't contain our location, we'll just keep our previous coords
                     if (rx->payload.game.coords[0].id != robot_id) {
@@ -306,12 +540,15 @@ void rf_process_packet (packet_buffer *rx, uint8_t size, uint8_t pipe) {
                     memcpy((char *)&locked_game, &rx->payload.game, sizeof(rx->payload.game));
                     uint32_t time_us = get_time_us();
                     locked_position_microtime = time_us;
-                    release(&objects_lock);
+                    GAME_BARRIER();
+                    game_seq++;
+                    thread_wakeup((void *)&game_seq);
                 }
             }
             break;
 
         case START:
+            rf_count_packet(rx);
             if (robot_id != 0xFF) {
                 //Remaining bytes are robots which are starting.  Check if we're one of them.
                 for (uint8_t i = 0; i < 30; i++) {
@@ -322,6 +559,7 @@ void rf_process_packet (packet_buffer *rx, uint8_t size, uint8_t pipe) {
             break;
 
         case STOP:
+            rf_count_packet(rx);
             if (robot_id != 0xFF) {
                 //Remaining bytes are robots which are stopping.  Check if we're one of them.
                 for (uint8_t i = 0; i < 30; i++) {
@@ -331,6 +569,10 @@ void rf_process_packet (packet_buffer *rx, uint8_t size, uint8_t pipe) {
             }
             break;
 
+        case REPLY_STRING:
+            rf_count_packet(rx);
+            break;
+
         case STRING:
             rf_buf_index = 0;
             memcpy((char *)rf_str_buf, rx->payload.array, PAYLOAD_SIZE);
@@ -341,29 +583,93 @@ void rf_process_packet (packet_buffer *rx, uint8_t size, uint8_t pipe) {
     }
 }
 
-//copy the locked_objects[] into the user-accessible objects[] array - this way users cannot stall the rf thread by holding the objects_lock too long
+uint8_t game_read(game_data *data, uint32_t *time_us) {
+    uint8_t seq;
+    for (;;) {
+        seq = game_seq;
+        if (seq & 1) {
+            // the RF thread is part way through an update
+            yield();
+            continue;
+        }
+        GAME_BARRIER();
+        memcpy(data, (char *)&locked_game, sizeof(locked_game));
+        if (time_us)
+            *time_us = locked_position_microtime;
+        GAME_BARRIER();
+        if (game_seq == seq)
+            return seq;
+    }
+}
+
+uint8_t game_read_fix(board_coord *coord, uint32_t *time_ms) {
+    uint8_t seq, count;
+    for (;;) {
+        seq = game_seq;
+        if (seq & 1) {
+            yield();
+            continue;
+        }
+        GAME_BARRIER();
+        memcpy(coord, (char *)&locked_game.coords[0], sizeof(*coord));
+        *time_ms = locked_fix_time;
+        count = locked_fix_count;
+        GAME_BARRIER();
+        if (game_seq == seq)
+            return count;
+    }
+}
+
+//copy the latest game data into the user-accessible game struct
 void copy_objects(){
-    acquire(&objects_lock);
-    memcpy((char*)&game, (char*)&locked_game, sizeof(locked_game));
-    position_microtime = locked_position_microtime;
-    release(&objects_lock);
+    game_data data;
+    uint32_t time_us;
+    game_read(&data, &time_us);
+    memcpy((char *)&game, &data, sizeof(data));
+    position_microtime = time_us;
+}
+
+uint8_t game_wait_update(uint32_t timeout) {
+    uint8_t seq = game_seq | 1;
+    uint8_t updated = 1;
+    uint32_t end = get_time() + timeout;
+
+    ATOMIC_BEGIN;
+    // an update in progress when we were called counts as new
+    while ((game_seq | 1) == seq) {
+        uint32_t now = get_time();
+        if ((int32_t)(end - now) <= 0) {
+            updated = 0;
+            break;
+        }
+        thread_sleep_timeout((void *)&game_seq, end - now);
+    }
+    ATOMIC_END;
+
+    copy_objects();
+    return updated;
 }
 
 // get a packet; return pipe number
 uint8_t rf_get_packet(uint8_t *buf, uint8_t *size) {
     uint8_t pipe;
+    nrf_begin();
     while (1) {
         pipe = ((nrf_read_reg(NRF_REG_STATUS) & NRF_RX_P_NO_MASK) >> NRF_RX_P_NO_BASE);
-        if (pipe == NRF_RX_P_NO_EMPTY)
+        if (pipe == NRF_RX_P_NO_EMPTY) {
+            nrf_end();
             return pipe;
+        }
         *size = nrf_read_rx_payload_len();
         if (*size > 32) {
+            rf_oversize++;
             nrf_flush_rx();
             continue;
         }
         break;
     }
     nrf_read_rx_payload(buf, *size);
+    nrf_end();
     return pipe;
 }
 
@@ -373,8 +679,23 @@ int rf_receive (void) {
 
 	#ifndef SIMULATE
 
+    rf_thread = current_thread;
+
     for (;;) {
-        //if (PINE & _BV(PD7)) {
+        // sleep until the radio raises its IRQ line or there is something to
+        // send; the line is level, so a packet that arrived while we were
+        // busy is not lost
+        ATOMIC_BEGIN;
+        while (!rf_irq_pending && !RF_IRQ_ASSERTED() && rf_tx_head == rf_tx_tail) {
+            if (!thread_sleep_timeout((void *)&rf_irq_pending, RF_IRQ_TIMEOUT))
+                break;
+        }
+        rf_irq_pending = 0;
+        ATOMIC_END;
+
+        if (rf_tx_head != rf_tx_tail)
+            rf_tx_burst();
+
         uint8_t status = nrf_read_status();
         if (status & _BV(NRF_BIT_RX_DR)) {
             nrf_write_reg(NRF_REG_STATUS, _BV(NRF_BIT_RX_DR)); //reset int
@@ -385,8 +706,6 @@ int rf_receive (void) {
             while ((pipe = rf_get_packet((uint8_t*)&rx, &size)) != NRF_RX_P_NO_EMPTY)
                 rf_process_packet(&rx, size, pipe);
         }
-        //}
-        yield();
     }
     return 0;
 
@@ -421,7 +740,6 @@ void rf_init (void) {
 
 	#ifndef SIMULATE
 
-    extern struct thread *current_thread;
     if (current_thread != NULL)
         return;
 
@@ -430,7 +748,7 @@ void rf_init (void) {
     // characters to be interleaved between threads
     init_lock(&rf_lock, "RF Lock");
 
-    init_lock(&objects_lock, "objects[] lock");
+    init_lock(&rf_radio_lock, "RF radio lock");
 
     // STRING packets don't contain the null character
     // for efficiency.  rf_str_buf is one character larger
@@ -439,7 +757,15 @@ void rf_init (void) {
 
     rf_new_str = 0;
 
+    acquire(&rf_radio_lock);
+    rf_configure();
     rf_rx(); //Enable receive mode
+    release(&rf_radio_lock);
+
+    // interrupt on the falling edge of the nRF IRQ line
+    EICRB = (EICRB & ~(_BV(ISC70) | _BV(ISC71))) | _BV(ISC71);
+    EIFR = _BV(INTF7);
+    EIMSK |= _BV(INT7);
 
 	#endif
 
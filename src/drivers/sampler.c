@@ -0,0 +1,449 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+// Background ADC sampling
+//
+// Every channel owns an SPI transaction that is resubmitted from the 1ms
+// tick when its period expires. The completion callback, which runs in the
+// SPI interrupt, publishes the sample into a double-buffered table: the
+// writer only ever touches the back buffer and then flips, so readers can
+// copy the front buffer without disabling interrupts.
+
+#ifndef SIMULATE
+
+#include <config.h>
+#include <sampler.h>
+#include <mcp3008.h>
+#include <hal/spi.h>
+#include <hal/io.h>
+#include <kern/global.h>
+#include <kern/lock.h>
+#include <kern/thread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/interrupt.h>
+
+struct sampler_filter {
+    uint8_t type;
+    uint8_t param;
+    uint8_t n;                  // samples in the current block, 0 = no input yet
+    uint8_t pos;                // next slot of hist
+    uint16_t coef;              // AVERAGE: 65536/param, rounded up
+    int32_t acc;                // AVERAGE: window sum, EMA: Q8 state, OVERSAMPLE: block sum
+    uint16_t *hist;             // AVERAGE, MEDIAN: last 'param' inputs
+};
+
+struct sampler_channel {
+    struct spi_transaction txn;
+    uint8_t cmd[3];
+    uint8_t rx[3];
+    uint8_t ch;
+    uint8_t valid;              // at least one sample published
+    uint16_t period;            // ms, 0 = disabled
+    uint32_t due;               // global_time of the next conversion
+    volatile uint8_t count;     // number of samples taken, wraps
+    uint8_t waiting;            // threads sleeping in sampler_read_fresh()
+    sampler_callback callback;
+    struct sampler_filter *filters; // SAMPLER_FILTER_STAGES, allocated on first use
+    volatile uint8_t nfilters;
+    uint16_t filtered;
+};
+
+extern volatile uint32_t global_time;
+extern struct thread *current_thread;
+extern struct lock spi_lock;
+
+static struct sampler_channel *channels = NULL;
+static struct sampler_entry *snap[2];
+static volatile uint8_t snap_front = 0;
+static volatile uint8_t snap_gen = 0;
+// channel updated in the front buffer but not yet in the back buffer
+static uint8_t snap_pending = SAMPLER_CHANNELS;
+static uint8_t sampler_active = 0;
+
+// keep the compiler from moving table accesses across the generation reads
+#define SAMPLER_BARRIER() asm volatile("" ::: "memory")
+
+#define SAMPLER_BUSY(c) ((c)->txn.status == SPI_TXN_PENDING || \
+                         (c)->txn.status == SPI_TXN_ACTIVE)
+
+// Run one filter stage on *v. Returns 0 if the stage holds the sample back.
+// Runs in the SPI interrupt.
+static uint8_t sampler_filter_run(struct sampler_filter *f, uint16_t *v) {
+    uint16_t x = *v;
+
+    switch (f->type) {
+        case SAMPLER_FILTER_AVERAGE:
+            if (!f->n) {
+                // start with a window full of the first sample
+                for (uint8_t i = 0; i < f->param; i++)
+                    f->hist[i] = x;
+                f->acc = (int32_t)x * f->param;
+                f->n = 1;
+            }
+            f->acc += (int32_t)x - (int32_t)f->hist[f->pos];
+            f->hist[f->pos] = x;
+            if (++f->pos == f->param)
+                f->pos = 0;
+            *v = ((uint32_t)f->acc * f->coef) >> 16;
+            return 1;
+
+        case SAMPLER_FILTER_MEDIAN: {
+            uint16_t sorted[7];
+            if (!f->n) {
+                for (uint8_t i = 0; i < f->param; i++)
+                    f->hist[i] = x;
+                f->n = 1;
+            }
+            f->hist[f->pos] = x;
+            if (++f->pos == f->param)
+                f->pos = 0;
+            // insertion sort, at most 7 values
+            for (uint8_t i = 0; i < f->param; i++) {
+                uint16_t h = f->hist[i];
+                uint8_t j = i;
+                for (; j > 0 && sorted[j-1] > h; j--)
+                    sorted[j] = sorted[j-1];
+                sorted[j] = h;
+            }
+            *v = sorted[f->param >> 1];
+            return 1;
+        }
+
+        case SAMPLER_FILTER_EMA:
+            if (!f->n) {
+                f->acc = (int32_t)x << 8;
+                f->n = 1;
+            }
+            f->acc += ((((int32_t)x << 8) - f->acc) * f->param) >> 8;
+            *v = (f->acc + 128) >> 8;
+            return 1;
+
+        case SAMPLER_FILTER_DECIMATE:
+            if (++f->n < f->param)
+                return 0;
+            f->n = 0;
+            return 1;
+
+        case SAMPLER_FILTER_OVERSAMPLE:
+            f->acc += x;
+            if (++f->n < (1 << (2*f->param)))
+                return 0;
+            *v = f->acc >> f->param;
+            f->acc = 0;
+            f->n = 0;
+            return 1;
+    }
+
+    return 1;
+}
+
+// runs in the SPI interrupt
+static void sampler_done(struct spi_transaction *t) {
+    struct sampler_channel *c = t->user;
+    uint16_t v = mcp3008_decode(c->rx);
+    uint32_t now = get_time_us();
+
+    uint16_t f = v;
+    uint8_t i;
+    for (i = 0; i < c->nfilters; i++)
+        if (!sampler_filter_run(&c->filters[i], &f))
+            break;
+    if (i == c->nfilters)
+        c->filtered = f;
+
+    uint8_t back = snap_front ^ 1;
+    if (snap_pending != SAMPLER_CHANNELS)
+        snap[back][snap_pending] = snap[snap_front][snap_pending];
+    snap[back][c->ch].value = v;
+    snap[back][c->ch].filtered = c->filtered;
+    snap[back][c->ch].time_us = now;
+    snap_front = back;
+    snap_pending = c->ch;
+    snap_gen++;
+
+    c->valid = 1;
+    c->count++;
+
+    if (c->callback)
+        c->callback(c->ch, v, now);
+    if (c->waiting)
+        thread_wakeup(c);
+}
+
+void sampler_init(void) {
+    channels = malloc(SAMPLER_CHANNELS * sizeof(struct sampler_channel));
+    snap[0] = malloc(SAMPLER_CHANNELS * sizeof(struct sampler_entry));
+    snap[1] = malloc(SAMPLER_CHANNELS * sizeof(struct sampler_entry));
+    if (!channels || !snap[0] || !snap[1])
+        panic("sampler_init");
+
+    memset(channels, 0, SAMPLER_CHANNELS * sizeof(struct sampler_channel));
+    memset(snap[0], 0, SAMPLER_CHANNELS * sizeof(struct sampler_entry));
+    memset(snap[1], 0, SAMPLER_CHANNELS * sizeof(struct sampler_entry));
+
+    for (uint8_t i = 0; i < SAMPLER_CHANNELS; i++) {
+        struct sampler_channel *c = &channels[i];
+        c->ch = i;
+        mcp3008_prepare(&c->txn, i / 8, MCP3008_CH0 + (i % 8), c->cmd);
+        c->txn.rx = c->rx;
+        c->txn.done = sampler_done;
+        c->txn.user = c;
+    }
+}
+
+void sampler_tick(void) {
+    if (!sampler_active)
+        return;
+
+    uint32_t now = global_time;
+    for (uint8_t i = 0; i < SAMPLER_CHANNELS; i++) {
+        struct sampler_channel *c = &channels[i];
+        if (!c->period || (int32_t)(now - c->due) < 0 || SAMPLER_BUSY(c))
+            continue;
+
+        c->due += c->period;
+        // don't try to catch up after falling behind
+        if ((int32_t)(now - c->due) >= 0)
+            c->due = now + c->period;
+        spi_submit(&c->txn);
+    }
+}
+
+void sampler_enable(uint8_t ch, uint16_t period_ms) {
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_enable");
+
+    ATOMIC_BEGIN;
+    channels[ch].period = period_ms;
+    channels[ch].due = global_time;
+
+    sampler_active = 0;
+    for (uint8_t i = 0; i < SAMPLER_CHANNELS; i++)
+        if (channels[i].period)
+            sampler_active = 1;
+    ATOMIC_END;
+}
+
+void sampler_disable(uint8_t ch) {
+    sampler_enable(ch, 0);
+}
+
+void sampler_set_callback(uint8_t ch, sampler_callback fn) {
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_set_callback");
+
+    ATOMIC_BEGIN;
+    channels[ch].callback = fn;
+    ATOMIC_END;
+}
+
+int8_t sampler_add_filter(uint8_t ch, uint8_t type, uint8_t param) {
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_add_filter");
+
+    switch (type) {
+        case SAMPLER_FILTER_AVERAGE:
+            if (param < 2 || param > 16) return -1;
+            break;
+        case SAMPLER_FILTER_MEDIAN:
+            if (param != 3 && param != 5 && param != 7) return -1;
+            break;
+        case SAMPLER_FILTER_EMA:
+        case SAMPLER_FILTER_DECIMATE:
+            if (param < 1) return -1;
+            break;
+        case SAMPLER_FILTER_OVERSAMPLE:
+            if (param < 1 || param > 3) return -1;
+            break;
+        default:
+            return -1;
+    }
+
+    struct sampler_channel *c = &channels[ch];
+    if (c->nfilters == SAMPLER_FILTER_STAGES)
+        return -1;
+    if (!c->filters) {
+        c->filters = malloc(SAMPLER_FILTER_STAGES * sizeof(struct sampler_filter));
+        if (!c->filters)
+            return -1;
+    }
+
+    // the interrupt doesn't look at a stage until nfilters covers it
+    struct sampler_filter *f = &c->filters[c->nfilters];
+    f->type = type;
+    f->param = param;
+    f->n = 0;
+    f->pos = 0;
+    f->acc = 0;
+    f->hist = NULL;
+    if (type == SAMPLER_FILTER_AVERAGE || type == SAMPLER_FILTER_MEDIAN) {
+        f->hist = malloc(param * sizeof(uint16_t));
+        if (!f->hist)
+            return -1;
+    }
+    f->coef = (65536UL + param - 1) / param;
+
+    ATOMIC_BEGIN;
+    c->nfilters++;
+    ATOMIC_END;
+
+    return 0;
+}
+
+void sampler_clear_filters(uint8_t ch) {
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_clear_filters");
+
+    struct sampler_channel *c = &channels[ch];
+    ATOMIC_BEGIN;
+    uint8_t n = c->nfilters;
+    c->nfilters = 0;
+    ATOMIC_END;
+
+    for (uint8_t i = 0; i < n; i++)
+        free(c->filters[i].hist);
+}
+
+uint8_t sampler_get_entry(uint8_t ch, struct sampler_entry *e) {
+    uint8_t gen;
+
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_get_entry");
+
+    // a single flip during the copy leaves the front buffer we started
+    // with alone; two or more may not
+    do {
+        gen = snap_gen;
+        SAMPLER_BARRIER();
+        *e = snap[snap_front][ch];
+        SAMPLER_BARRIER();
+    } while ((uint8_t)(snap_gen - gen) > 1);
+
+    return channels[ch].valid;
+}
+
+void sampler_get_snapshot(struct sampler_entry *table) {
+    uint8_t gen;
+
+    do {
+        gen = snap_gen;
+        SAMPLER_BARRIER();
+        memcpy(table, snap[snap_front], SAMPLER_CHANNELS * sizeof(struct sampler_entry));
+        SAMPLER_BARRIER();
+    } while ((uint8_t)(snap_gen - gen) > 1);
+}
+
+void sampler_get_values(uint8_t first, uint8_t n, uint16_t *values) {
+    uint8_t gen;
+
+    if (first + n > SAMPLER_CHANNELS)
+        panic("sampler_get_values");
+
+    do {
+        gen = snap_gen;
+        SAMPLER_BARRIER();
+        struct sampler_entry *table = snap[snap_front];
+        for (uint8_t i = 0; i < n; i++)
+            values[i] = table[first + i].value;
+        SAMPLER_BARRIER();
+    } while ((uint8_t)(snap_gen - gen) > 1);
+}
+
+uint16_t sampler_read_fresh(uint8_t ch) {
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_read_fresh");
+
+    // without a thread to put to sleep, or before the sampler is up, ask
+    // the ADC directly
+    if (!channels || !current_thread || !(SREG & SREG_IF) || is_held(&spi_lock)) {
+        uint16_t v;
+        mcp3008_get_sample(ch / 8, MCP3008_CH0 + (ch % 8), &v);
+        return v;
+    }
+
+    struct sampler_channel *c = &channels[ch];
+    struct sampler_entry e;
+
+    ATOMIC_BEGIN;
+    // a conversion already on the bus started before we were called
+    uint8_t target = c->count + (c->txn.status == SPI_TXN_ACTIVE ? 2 : 1);
+    c->waiting++;
+    while ((int8_t)(c->count - target) < 0) {
+        if (!SAMPLER_BUSY(c))
+            spi_submit(&c->txn);
+        thread_sleep(c);
+    }
+    c->waiting--;
+    ATOMIC_END;
+
+    sampler_get_entry(ch, &e);
+    return e.value;
+}
+
+// latest entry of 'ch', enabling the channel and waiting for its first
+// sample if needed
+static void sampler_read_entry(uint8_t ch, struct sampler_entry *e) {
+    if (!channels[ch].period)
+        sampler_enable(ch, SAMPLER_DEFAULT_PERIOD);
+
+    if (!sampler_get_entry(ch, e)) {
+        // outside of a thread the fresh sample doesn't go into the table
+        uint16_t v = sampler_read_fresh(ch);
+        if (!sampler_get_entry(ch, e)) {
+            e->value = v;
+            e->filtered = v;
+            e->time_us = get_time_us();
+        }
+    }
+}
+
+uint16_t sampler_read(uint8_t ch) {
+    struct sampler_entry e;
+
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_read");
+
+    if (!channels)
+        return sampler_read_fresh(ch);
+
+    sampler_read_entry(ch, &e);
+    return e.value;
+}
+
+uint16_t sampler_read_filtered(uint8_t ch) {
+    struct sampler_entry e;
+
+    if (ch >= SAMPLER_CHANNELS)
+        panic("sampler_read_filtered");
+
+    if (!channels)
+        return sampler_read_fresh(ch);
+
+    sampler_read_entry(ch, &e);
+    return e.filtered;
+}
+
+#endif
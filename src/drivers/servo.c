@@ -27,7 +27,10 @@
 
 #include <config.h>
 #include <fpga.h>
+#include <servo.h>
 #include <kern/lock.h>
+#include <kern/periodic.h>
+#include <kern/thread.h>
 
 #else
 
@@ -52,31 +55,184 @@
 #define SERVO_RAW_MIN   65
 #define SERVO_RAW_MAX   595
 #define SERVO_RAW_RANGE 530 // (SERVO_RAW_MAX-SERVO_RAW_MIN)
-#define SERVO_RAW_SCALE (((float)SERVO_RAW_RANGE)/511.0)
+// (SERVO_RAW_RANGE/511.0) in Q8
+#define SERVO_RAW_SCALE_Q8 ((SERVO_RAW_RANGE*256UL + 510)/511)
 #define SERVO_ENABLE 0x8000
 
+// position units per second (or second^2) to Q8 units per tick (or tick^2)
+#define SERVO_VEL_Q8(v) ((int32_t)(v)*256*SERVO_UPDATE_PERIOD/1000)
+#define SERVO_ACC_Q8(a) ((int32_t)(a)*256*SERVO_UPDATE_PERIOD*SERVO_UPDATE_PERIOD/1000000)
+
+struct servo_motion {
+    int32_t pos;        // current position, Q8
+    int32_t vel;        // current velocity, Q8 per tick
+    int32_t move_vel;   // speed implied by the move's duration, Q8 per tick
+    uint16_t target;
+    uint16_t lower;
+    uint16_t upper;
+    int32_t max_vel;    // Q8 per tick, 0 = unlimited
+    int32_t max_acc;    // Q8 per tick^2, 0 = unlimited
+    uint8_t known;      // pos is meaningful
+    uint8_t moving;
+};
+
 struct lock servo_lock;
+static struct servo_motion servo_motion[6];
+static struct periodic_task servo_task;
+
+void servo_set_pos_raw(uint8_t servo, uint16_t pos) {
+    pos |= SERVO_ENABLE;
+    uint8_t sbase = FPGA_SERVO_BASE + servo*FPGA_SERVO_SIZE;
+
+    acquire (&servo_lock);
+    fpga_write_byte(sbase+FPGA_SERVO_LO,pos&0xFF);
+    fpga_write_byte(sbase+FPGA_SERVO_HI,(pos>>8));
+    release (&servo_lock);
+}
+
+static void servo_write(uint8_t servo, uint16_t pos) {
+    uint16_t posRaw = SERVO_RAW_MIN + (uint16_t)(((uint32_t)pos*SERVO_RAW_SCALE_Q8) >> 8);
+    servo_set_pos_raw(servo, posRaw);
+}
+
+static uint16_t isqrt32(uint32_t x) {
+    uint32_t res = 0;
+    uint32_t bit = 1UL << 30;
+    while (bit > x)
+        bit >>= 2;
+    while (bit) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return res;
+}
+
+// advance one servo by one tick. Call with servo_lock held.
+static void servo_step(uint8_t servo) {
+    struct servo_motion *m = &servo_motion[servo];
+    int32_t remaining = ((int32_t)m->target << 8) - m->pos;
+    int8_t dir = remaining < 0 ? -1 : 1;
+    int32_t dist = remaining * dir;
+    // speed towards the target; negative while still moving away from it
+    int32_t v = m->vel * dir;
+
+    int32_t cap = m->move_vel;
+    if (m->max_vel && (!cap || m->max_vel < cap))
+        cap = m->max_vel;
+
+    if (m->max_acc) {
+        v += m->max_acc;
+        // leave room to stop at the target
+        int32_t v_stop = isqrt32(2 * (uint32_t)m->max_acc * dist);
+        if (v > v_stop)
+            v = v_stop > m->max_acc ? v_stop : m->max_acc;
+    } else {
+        v = cap;
+    }
+    if (cap && v > cap)
+        v = cap;
+
+    if (v >= dist) {
+        m->pos = (int32_t)m->target << 8;
+        m->vel = 0;
+        m->moving = 0;
+    } else {
+        m->pos += v * dir;
+        m->vel = v * dir;
+    }
+    servo_write(servo, (m->pos + 128) >> 8);
+}
+
+static void servo_update(void *arg) {
+    acquire (&servo_lock);
+    for (uint8_t i = 0; i < 6; i++) {
+        if (servo_motion[i].moving)
+            servo_step(i);
+    }
+    release (&servo_lock);
+}
 
 void servo_init (void) {
     init_lock (&servo_lock, "servo lock");
+    for (uint8_t i = 0; i < 6; i++) {
+        servo_motion[i].lower = 0;
+        servo_motion[i].upper = 511;
+    }
+    periodic_add(&servo_task, servo_update, NULL, SERVO_UPDATE_PERIOD);
 }
 
 void servo_disable(uint8_t servo) {
     uint8_t sbase = FPGA_SERVO_BASE + servo*FPGA_SERVO_SIZE;
     acquire (&servo_lock);
+    servo_motion[servo].moving = 0;
+    servo_motion[servo].vel = 0;
     fpga_write_byte(sbase+FPGA_SERVO_LO, 0);
     fpga_write_byte(sbase+FPGA_SERVO_HI, 0);
     release (&servo_lock);
 }
 
-void servo_set_pos_raw(uint8_t servo, uint16_t pos) {
-    pos |= SERVO_ENABLE;
-    uint8_t sbase = FPGA_SERVO_BASE + servo*FPGA_SERVO_SIZE;
+void servo_move_to(uint8_t servo, uint16_t pos, uint16_t duration) {
+    struct servo_motion *m = &servo_motion[servo];
 
     acquire (&servo_lock);
-    fpga_write_byte(sbase+FPGA_SERVO_LO,pos&0xFF);
-    fpga_write_byte(sbase+FPGA_SERVO_HI,(pos>>8));
+    if (pos < m->lower)
+        pos = m->lower;
+    else if (pos > m->upper)
+        pos = m->upper;
+    m->target = pos;
+
+    if (!m->known || (!duration && !m->max_vel && !m->max_acc)) {
+        // nothing to interpolate from, or no limits: go straight there
+        m->pos = (int32_t)pos << 8;
+        m->vel = 0;
+        m->moving = 0;
+        m->known = 1;
+        servo_write(servo, pos);
+    } else {
+        m->move_vel = 0;
+        if (duration) {
+            int32_t dist = ((int32_t)pos << 8) - m->pos;
+            if (dist < 0)
+                dist = -dist;
+            uint16_t ticks = (duration + SERVO_UPDATE_PERIOD - 1) / SERVO_UPDATE_PERIOD;
+            m->move_vel = dist / ticks + 1;
+        }
+        m->moving = 1;
+    }
+    release (&servo_lock);
+}
+
+void servo_set_limits(uint8_t servo, uint16_t max_vel, uint16_t max_acc) {
+    acquire (&servo_lock);
+    servo_motion[servo].max_vel = SERVO_VEL_Q8(max_vel);
+    servo_motion[servo].max_acc = SERVO_ACC_Q8(max_acc);
+    // keep very small limits from rounding down to unlimited
+    if (max_vel && !servo_motion[servo].max_vel)
+        servo_motion[servo].max_vel = 1;
+    if (max_acc && !servo_motion[servo].max_acc)
+        servo_motion[servo].max_acc = 1;
+    release (&servo_lock);
+}
+
+uint16_t servo_get_pos(uint8_t servo) {
+    acquire (&servo_lock);
+    uint16_t pos = (servo_motion[servo].pos + 128) >> 8;
     release (&servo_lock);
+    return pos;
+}
+
+uint8_t servo_is_moving(uint8_t servo) {
+    return servo_motion[servo].moving;
+}
+
+void servo_wait(uint8_t servo) {
+    while (servo_motion[servo].moving)
+        pause(SERVO_UPDATE_PERIOD);
 }
 
 #endif
@@ -86,12 +242,21 @@ void servo_set_pos(uint8_t servo, uint16_t pos) {
 
 	#ifndef SIMULATE
 
-    uint16_t posRaw = SERVO_RAW_MIN + (uint16_t)((float)(pos)*SERVO_RAW_SCALE);
-    servo_set_pos_raw(servo,posRaw);
+    servo_move_to(servo, pos, 0);
 
 	#endif
 
 }
 
 void servo_set_range(uint8_t servo, uint16_t lower, uint16_t upper) {
+
+	#ifndef SIMULATE
+
+    acquire (&servo_lock);
+    servo_motion[servo].lower = lower;
+    servo_motion[servo].upper = upper > 511 ? 511 : upper;
+    release (&servo_lock);
+
+	#endif
+
 }
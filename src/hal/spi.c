@@ -28,29 +28,9 @@
 #include "config.h"
 #include "hal/io.h"
 #include "hal/spi.h"
-#include <kern/lock.h>
-#include <kern/global.h>
 
-//static uint8_t in_use = 0;
-
-struct lock spi_lock;
-
-void spi_init (void) {
-    init_lock(&spi_lock, "spi lock");
-}
-
-int8_t spi_acquire() {
-    acquire(&spi_lock);
-    return SPI_READY;
-}
-
-int spi_try_acquire() {
-    return try_acquire(&spi_lock);
-}
-
-void spi_release () {
-    release(&spi_lock);
-}
+// spi_init() and the bus lock live in spi_async.c, together with the
+// transaction engine, since the bootloader only uses what is in this file.
 
 void spi_set_master (spi_clk_div div, uint8_t flags) {
     // set spi control reg:
@@ -58,11 +38,17 @@ void spi_set_master (spi_clk_div div, uint8_t flags) {
     // MSTR - master mode
     // flags - see spi.h
     // div - high two bits of div are divides, low bit is 2X multiplier
-    SPCR = _BV(SPE) | _BV(MSTR) | flags | (div>>1);
+    uint8_t spcr = _BV(SPE) | _BV(MSTR) | flags | (div>>1);
+    // skip the writes if the bus is already set up this way, which is the
+    // common case for back-to-back transfers to the same device. SPIE
+    // belongs to the transaction engine and is left alone.
+    if ((SPCR & ~_BV(SPIE)) != spcr)
+        SPCR = spcr | (SPCR & _BV(SPIE));
     // set multiplier flag
-    if (div&1)
-        SPSR |= _BV(SPI2X);
-    else
+    if (div&1) {
+        if (!(SPSR & _BV(SPI2X)))
+            SPSR |= _BV(SPI2X);
+    } else if (SPSR & _BV(SPI2X))
         SPSR &= ~_BV(SPI2X);
 }
 
@@ -0,0 +1,224 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+// Interrupt-driven SPI transaction queue
+//
+// Transactions are run one byte per SPI interrupt, in the order they were
+// submitted. The bus lock (spi_lock) is shared with the polled interface in
+// spi.c: queued transactions only start while nobody holds the lock, and
+// spi_acquire() waits for the transaction in progress to finish.
+
+#ifndef SIMULATE
+
+#include "config.h"
+#include "hal/io.h"
+#include "hal/spi.h"
+#include <kern/lock.h>
+#include <kern/global.h>
+#include <kern/thread.h>
+#include <avr/interrupt.h>
+
+struct lock spi_lock;
+
+extern struct thread *current_thread;
+
+static struct spi_transaction *spi_queue_head = NULL;
+static struct spi_transaction *spi_queue_tail = NULL;
+// transaction on the bus, NULL if the engine is idle
+static struct spi_transaction *volatile spi_active = NULL;
+static uint8_t spi_pos;
+
+void spi_init (void) {
+    init_lock(&spi_lock, "spi lock");
+}
+
+static void spi_select (spi_device dev, uint8_t v) {
+    switch (dev) {
+        case SPI_DEV_ADC1:  SPI_ADC1_SS(v); break;
+        case SPI_DEV_ADC2:  SPI_ADC2_SS(v); break;
+        case SPI_DEV_MOTOR: SPI_MOTOR_SS(v); break;
+        case SPI_DEV_RF:    SPI_RF_SS(v); break;
+        case SPI_DEV_FLASH: SPI_FLASH_SS(v); break;
+        default: break;
+    }
+}
+
+// Start the next queued transaction if the engine is idle.
+// With 'force', the bus may be locked by the current thread.
+// Called with interrupts disabled.
+static void spi_engine_start (uint8_t force) {
+    if (spi_active)
+        return;
+
+    if (!spi_queue_head || (spi_lock.locked && !(force && is_held(&spi_lock)))) {
+        // going idle, let spi_acquire() in
+        SPCR &= ~_BV(SPIE);
+        thread_wakeup((void *)&spi_active);
+        return;
+    }
+
+    struct spi_transaction *t = spi_queue_head;
+    spi_queue_head = t->next;
+    if (!spi_queue_head)
+        spi_queue_tail = NULL;
+
+    spi_active = t;
+    spi_pos = 0;
+    t->status = SPI_TXN_ACTIVE;
+
+    spi_set_master(t->div, t->flags);
+    spi_select(t->dev, 0);
+    SPDR = t->tx ? t->tx[0] : 0;
+    SPCR |= _BV(SPIE);
+}
+
+// Handle the completion of one byte. Called with interrupts disabled.
+static void spi_engine_service (void) {
+    struct spi_transaction *t = spi_active;
+    uint8_t b = SPDR;
+
+    if (t->rx)
+        t->rx[spi_pos] = b;
+
+    if (++spi_pos < t->len) {
+        SPDR = t->tx ? t->tx[spi_pos] : 0;
+        return;
+    }
+
+    spi_select(t->dev, 1);
+    spi_active = NULL;
+    t->status = SPI_TXN_DONE;
+
+    if (t->done)
+        t->done(t);
+    thread_wakeup(t);
+
+    spi_engine_start(0);
+}
+
+// Run the engine by hand, for when the interrupt can't.
+// Called with interrupts disabled.
+static void spi_engine_poll (void) {
+    if (!spi_active) {
+        spi_engine_start(1);
+        if (!spi_active)
+            panic("spi deadlock -- bus locked by another thread");
+        return;
+    }
+
+    while (!(SPSR & _BV(SPIF)));
+    spi_engine_service();
+}
+
+ISR(SPI_STC_vect) {
+    if (spi_active)
+        spi_engine_service();
+}
+
+int8_t spi_acquire() {
+    acquire(&spi_lock);
+
+    // wait for the transaction on the bus to finish; no new ones will
+    // start while we hold the lock
+    ATOMIC_BEGIN;
+    while (spi_active) {
+        if (_cli_was_enabled && current_thread)
+            thread_sleep((void *)&spi_active);
+        else
+            spi_engine_poll();
+    }
+    ATOMIC_END;
+
+    return SPI_READY;
+}
+
+int spi_try_acquire() {
+    if (!try_acquire(&spi_lock))
+        return 0;
+
+    ATOMIC_BEGIN;
+    uint8_t busy = (spi_active != NULL);
+    ATOMIC_END;
+
+    if (busy) {
+        release(&spi_lock);
+        return 0;
+    }
+
+    return 1;
+}
+
+void spi_release () {
+    release(&spi_lock);
+
+    // run whatever was queued while the bus was locked
+    ATOMIC_BEGIN;
+    spi_engine_start(0);
+    ATOMIC_END;
+}
+
+void spi_submit (struct spi_transaction *t) {
+    ATOMIC_BEGIN;
+
+    if (t->len == 0) {
+        t->status = SPI_TXN_DONE;
+        if (t->done)
+            t->done(t);
+        ATOMIC_END;
+        return;
+    }
+
+    t->status = SPI_TXN_PENDING;
+    t->next = NULL;
+    if (spi_queue_tail)
+        spi_queue_tail->next = t;
+    else
+        spi_queue_head = t;
+    spi_queue_tail = t;
+
+    spi_engine_start(0);
+
+    ATOMIC_END;
+}
+
+void spi_wait (struct spi_transaction *t) {
+    ATOMIC_BEGIN;
+    while (t->status != SPI_TXN_DONE) {
+        // nobody else will finish it if interrupts are off, and nobody
+        // will start it while we hold the lock
+        if (_cli_was_enabled && current_thread && !is_held(&spi_lock))
+            thread_sleep(t);
+        else
+            spi_engine_poll();
+    }
+    ATOMIC_END;
+}
+
+void spi_transfer (struct spi_transaction *t) {
+    spi_submit(t);
+    spi_wait(t);
+}
+
+#endif
@@ -31,6 +31,9 @@
 #include "hal/io.h"
 #endif
 #include <kern/lock.h>
+#ifndef SIMULATE
+#include <kern/log.h>
+#endif
 #ifdef SIMULATE
 #include <stdio.h>
 #include <stdarg.h>
@@ -46,6 +49,8 @@ struct lock uart_lock;
 
 int uart_send(char ch) {
     LED_COMM(1);
+    // don't cut into a log record being sent by the interrupt
+    log_uart_claim();
     while (!(UCSR0A & _BV(UDRE0)));
     UDR0 = ch;
     LED_COMM(0);
@@ -69,6 +74,7 @@ int uart_vprintf(const char *fmt, va_list ap) {
     acquire(&uart_lock);
     count = vfprintf(&uartio, fmt, ap);
     release(&uart_lock);
+    log_kick();
 
     return count;
 }
@@ -97,6 +103,7 @@ int uart_vprintf_P(const char *fmt, va_list ap) {
     acquire(&uart_lock);
     count = vfprintf_P(&uartio, fmt, ap);
     release(&uart_lock);
+    log_kick();
 
     return count;
 }
@@ -132,6 +139,7 @@ int uart_vscanf(const char *fmt, va_list ap){
     acquire(&uart_lock);
     count = vfscanf(&uartio, fmt, ap);
     release(&uart_lock);
+    log_kick();
 
     return count;
 }
@@ -161,6 +169,7 @@ int uart_vscanf_P(const char *fmt, va_list ap) {
     acquire(&uart_lock);
     count = vfscanf_P(&uartio, fmt,ap);
     release(&uart_lock);
+    log_kick();
 
     return count;
 }
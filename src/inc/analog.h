@@ -41,6 +41,12 @@
  * (Also, the bottleneck analog input sampling is usually processing code,
  * rather than the actual data acquisition).
  *
+ * The ports are sampled in the background by the sampler (see sampler.h).
+ * The first analog_read() of a port starts sampling it every
+ * SAMPLER_DEFAULT_PERIOD ms; after that analog_read() returns the latest
+ * sample right away. Use analog_read_fresh() when a sample taken after the
+ * call is needed, or sampler_enable() to sample a port at another rate.
+ *
  * The analog, digital, and encoder inputs (as well as the LCD) are run off a
  * separate 5V regulated supply. This supply can supply up to 400mA to power
  * the input sensors.
@@ -57,4 +63,30 @@
  */
 uint16_t analog_read(uint8_t port);
 
+#ifndef SIMULATE
+
+/**
+ * Read an analog port value, waiting for a new conversion.
+ * @param port port number to read (8..23).
+ * @return Value read by the analog port (0..1023)
+ */
+uint16_t analog_read_fresh(uint8_t port);
+
+/**
+ * Read the output of the filters attached to an analog port with
+ * sampler_add_filter(). Without filters this is the same as analog_read().
+ * @param port port number to read (8..23).
+ * @return Filtered value; the range depends on the filters (0..1023 without
+ *         oversampling).
+ */
+uint16_t analog_read_filtered(uint8_t port);
+
+/**
+ * Return the sampler channel (see sampler.h) of an analog port.
+ * @param port port number (8..23).
+ */
+uint8_t analog_port_channel(uint8_t port);
+
+#endif
+
 #endif
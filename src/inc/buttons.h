@@ -43,32 +43,35 @@
  */
 
 /**
- * Check if the 'Go' button is pressed.
+ * Check if the 'Go' button is pressed. The result is debounced once
+ * the scheduler is running.
  * @return true if go is pressed.
  */
 uint8_t go_press();
 
 /**
- * Check if the 'Stop' button is pressed.
+ * Check if the 'Stop' button is pressed. The result is debounced once
+ * the scheduler is running.
  * @return true if stop is pressed.
  */
 uint8_t stop_press();
 
 /**
- * Wait for the user to click one of the two buttons.
+ * Wait for the user to click one of the two buttons. Only clicks started
+ * after the call count, and the calling thread sleeps while waiting.
  * Returns 0 if Stop was pressed.
  */
 int either_click();
 
 /**
  * Wait for the user to click the 'Go' button.
- * This will loop until the 'Go' button is pressed and released.
+ * This will sleep until the 'Go' button is pressed and released.
  */
 void go_click();
 
 /**
  * Wait for the user to click the 'Stop' button.
- * This will loop until the 'Stop' button is pressed and released.
+ * This will sleep until the 'Stop' button is pressed and released.
  */
 void stop_click();
 
@@ -92,12 +95,181 @@ uint16_t frob_read_range(uint16_t min, uint16_t max);
  */
 uint16_t read_battery();
 
+#ifndef SIMULATE
+
+/// Default low battery threshold, in millivolts
+#define BATTERY_LOW_DEFAULT_MV  7200
+/// Maximum number of low battery handlers
+#define BATTERY_HANDLERS        2
+
+/**
+ * Low battery handler. Called when the battery becomes low or recovers.
+ * Runs on the periodic thread, so it must not block.
+ *
+ * @param mv    Filtered battery voltage in millivolts.
+ * @param low   1 if the battery has become low, 0 if it has recovered.
+ */
+typedef void (*battery_handler)(uint16_t mv, uint8_t low);
+
+/** Start the battery monitor. Should not be called by user. */
+void battery_init(void);
+
+/**
+ * Read the battery voltage, filtered to remove the dips caused by motor
+ * current spikes. The battery is sampled in the background, so this is
+ * cheap to call often.
+ * @return The battery voltage in millivolts.
+ */
+uint16_t read_battery_filtered(void);
+
+/**
+ * Set the voltage below which the battery counts as low. The default is
+ * BATTERY_LOW_DEFAULT_MV.
+ * @param mv    Threshold in millivolts.
+ */
+void battery_set_low_threshold(uint16_t mv);
+
+/**
+ * Check if the battery is low.
+ * @return 1 if the filtered battery voltage is below the low threshold.
+ */
+uint8_t battery_is_low(void);
+
+/**
+ * Register a function to be called when the battery becomes low or
+ * recovers.
+ * @param handler   Function to call.
+ * @return 0 on success, -1 if BATTERY_HANDLERS handlers are registered.
+ */
+int8_t battery_subscribe(battery_handler handler);
+
+#endif
+
+#ifndef SIMULATE
+
+/// Number of buttons
+#define BUTTONS                 2
+/// Button number of 'Go'
+#define BUTTON_GO               0
+/// Button number of 'Stop'
+#define BUTTON_STOP             1
+
+/// Event type: button pressed
+#define BUTTON_PRESS            1
+/// Event type: button released
+#define BUTTON_RELEASE          2
+/// Event type: button held down for BUTTON_LONG_MS
+#define BUTTON_LONG             3
+
+/// Make an event from a button number and event type
+#define BUTTON_EVENT(b, type)   (((b) << 4) | (type))
+/// Button number of an event
+#define BUTTON_EVENT_BUTTON(e)  ((e) >> 4)
+/// Type of an event
+#define BUTTON_EVENT_TYPE(e)    ((e) & 0x0F)
+
+/// Buttons are sampled this often, in milliseconds
+#define BUTTON_SAMPLE_PERIOD    5
+/// How long a button must be held for a BUTTON_LONG event, in milliseconds
+#define BUTTON_LONG_MS          1000
+/// Timeout for button_get_event() that waits forever
+#define BUTTON_WAIT_FOREVER     0xFFFFFFFFUL
+
+/** Start sampling the buttons. Should not be called by user. */
+void buttons_init(void);
+
+/**
+ * Wait for a button event. The buttons are sampled and debounced in the
+ * background, and each press, release and long press is queued; the queue
+ * holds a few events and drops new ones when full. The calling thread
+ * sleeps while waiting, so other threads keep running.
+ *
+ * Events are removed from the queue when read, so only one thread should
+ * wait for button events at a time. go_click(), stop_click() and
+ * either_click() use the same queue.
+ *
+ * \code
+ * uint8_t e = button_get_event(BUTTON_WAIT_FOREVER);
+ * if (BUTTON_EVENT_BUTTON(e) == BUTTON_GO && BUTTON_EVENT_TYPE(e) == BUTTON_LONG)
+ *     ...
+ * \endcode
+ *
+ * @param timeout   Longest time to wait in milliseconds, 0 to return at once,
+ *                  or BUTTON_WAIT_FOREVER.
+ * @return The event, or 0 if the timeout expired first.
+ */
+uint8_t button_get_event(uint32_t timeout);
+
+/**
+ * Discard all queued button events.
+ */
+void button_flush_events(void);
+
+#endif
+
 /**
- * Beep at a given frequency for a given duration.
+ * Beep at a given frequency for a given duration. Waits until the tone,
+ * and any tones queued before it, have finished playing.
  *
  * @param freq      Frequency to beep
  * @param duration  Duration of beep
  */
 void beep(uint16_t freq, uint16_t duration);
 
+#ifndef SIMULATE
+
+/// A tone for beep_sequence()
+struct beep_tone {
+    uint16_t freq;          ///< frequency in Hz, 0 for silence
+    uint16_t duration;      ///< duration in milliseconds
+};
+
+/**
+ * Queue a tone and return at once. The tone is generated by a hardware
+ * timer, so it costs no processor time while it plays. Tones play one
+ * after another, and at most 8 can be queued.
+ * @param freq      Frequency in Hz (16Hz and up), 0 for silence
+ * @param duration  Duration in milliseconds
+ * @return 0 on success, -1 if the queue is full.
+ */
+int8_t beep_async(uint16_t freq, uint16_t duration);
+
+/**
+ * Queue a sequence of tones and return at once. Either the whole sequence
+ * is queued or none of it.
+ *
+ * \code
+ * static const struct beep_tone ready[] = {
+ *     { 880, 100 }, { 0, 50 }, { 1320, 150 },
+ * };
+ * beep_sequence(ready, 3);
+ * \endcode
+ *
+ * @param tones Tones to play, copied into the queue.
+ * @param n     Number of tones.
+ * @return 0 on success, -1 if there is not room for all of them.
+ */
+int8_t beep_sequence(const struct beep_tone *tones, uint8_t n);
+
+/**
+ * Stop the current tone and discard the queue.
+ */
+void beep_stop(void);
+
+/**
+ * Check if a tone is playing.
+ * @return 1 if a tone is playing or queued.
+ */
+uint8_t beep_busy(void);
+
+/**
+ * Sleep until all queued tones have finished.
+ */
+void beep_wait(void);
+
+/** Advance the tone queue. Called from the system tick; should not be called by user. */
+void beeper_tick(void);
+
+#endif
+
 #endif
@@ -38,6 +38,11 @@
  * this users should read digital inputs a few times with short delays between
  * readings to ensure accurate sensing.
  *
+ * Alternatively, the FPGA counts debounced closures (high to low
+ * transitions) on each digital input, so bump sensors and break-beams can be
+ * counted with digital_count() without polling. With FPGA images older than
+ * 0.12 the inputs are polled every 5ms instead.
+ *
  */
 
 /** Initialize digital ports. Should not be called by user. */
@@ -52,6 +57,33 @@ uint8_t digital_read_8();
 
 #ifndef SIMULATE
 
+/**
+ * Detect edge counter support once the FPGA is configured. Should not be
+ * called by user.
+ */
+void digital_probe (void);
+
+/**
+ * Return the value of all 24 ports (0-23) as a bitmask, bit n for port n.
+ * Analog ports read as in digital_read(), but from the background sampler
+ * rather than with a conversion per port, so this is cheap to call often.
+ * Unlike digital_read(), ports 0-7 are not switched to inputs.
+ */
+uint32_t digital_read_all(void);
+
+/**
+ * Return the number of times a digital port has closed (gone from high to
+ * low) since the last digital_count_reset(). Wraps at 65536.
+ * @param port  port to read (0-7)
+ */
+uint16_t digital_count(uint8_t port);
+
+/**
+ * Reset the closure count of a digital port.
+ * @param port  port to reset (0-7)
+ */
+void digital_count_reset(uint8_t port);
+
 /**
  * Return the value of a specific digital port.
  * If the port specified is an analog port (8-23), digital_read() returns the
@@ -30,14 +30,46 @@
  * \file encoder.h
  * \brief Shaft Encoders.
  *
- * The Happyboard has 4 16-bit shaft encoders. The shaft encoders are fed
+ * The Happyboard has 4 shaft encoders. The shaft encoders are fed
  * into the FPGA which manages the filtering and counting. The inputs are
  * filtered with a simple debouncing-filter to remove spurious counts.
+ *
+ * By default each input counts rising edges. An adjacent pair of inputs
+ * (24/25 or 26/27) can instead be decoded as a quadrature encoder, which
+ * counts up or down with the direction of rotation. The count appears on
+ * the first encoder of the pair.
+ *
+ * The FPGA keeps signed 32-bit counts (FPGA version 0.8 and later), read with
+ * encoder_read32(), which do not wrap during a match. encoder_read() returns
+ * the low 16 bits. With an older FPGA image, encoder_read32() extends the
+ * 16-bit count in software, which only works if it is called at least once
+ * every 65535 counts, and quadrature decoding is unavailable.
+ *
+ * From FPGA version 0.9 the FPGA also times the interval between counts,
+ * which encoder_get_velocity() uses to measure slow shafts without waiting
+ * for several counts to accumulate.
+ *
+ * encoder_read_all() samples all four counts at the same instant, which
+ * matters when comparing a left and a right wheel.
  */
 
+/**
+ * All four encoder counts, sampled together.
+ */
+struct encoder_snapshot {
+    uint32_t time_us;   ///< sample time, from a free-running microsecond clock
+    int32_t count[4];   ///< count of encoders 24-27, as from encoder_read32()
+};
+
 /** Initialize the encoders. Should not be called by user. */
 void encoder_init (void);
 
+/**
+ * Detect 32-bit counter support once the FPGA is configured. Should not be
+ * called by user.
+ */
+void encoder_probe (void);
+
 /**
  * Reset the encoder count value for a specific shaft encoder
  * @param encoder encoder to reset (24-27)
@@ -50,4 +82,54 @@ void encoder_reset(uint8_t encoder);
  */
 uint16_t encoder_read(uint8_t encoder);
 
+/**
+ * Return the signed 32-bit count value for a specific shaft encoder
+ * @param encoder   encoder to read (24-27)
+ */
+int32_t encoder_read32(uint8_t encoder);
+
+/**
+ * Sample all four encoders at once.
+ *
+ * With FPGA version 0.10 and later the counts are latched by the FPGA in the
+ * same clock cycle, and time_us comes from a microsecond counter in the FPGA
+ * (it is not related to get_time_us()). Otherwise the encoders are read one
+ * after the other with interrupts disabled, and time_us is get_time_us().
+ *
+ * @param snap  structure to fill in
+ */
+void encoder_read_all(struct encoder_snapshot *snap);
+
+/**
+ * Return the speed of a specific shaft encoder, in thousandths of a count
+ * per second. Negative values are only possible in quadrature mode.
+ *
+ * When the shaft is turning slowly the speed comes from the time between the
+ * last two counts, and decays towards zero as the next count takes longer to
+ * arrive. When several counts have arrived since the last call it is the
+ * average over that interval instead. Without FPGA support only the count
+ * method is available, and the result is the average since the last call.
+ *
+ * @param encoder   encoder to read (24-27)
+ */
+int32_t encoder_get_velocity(uint8_t encoder);
+
+/**
+ * Decode an encoder pair as a quadrature encoder, or return it to counting
+ * rising edges. The encoder is reset.
+ * @param encoder   first encoder of the pair (24 or 26)
+ * @param enabled   nonzero to decode quadrature
+ * @return 0 on success, -1 if the encoder is not 24 or 26 or the FPGA does
+ *         not support quadrature decoding
+ */
+int8_t encoder_set_quadrature(uint8_t encoder, uint8_t enabled);
+
+/**
+ * Check if an encoder is decoding quadrature, and so counts down as well
+ * as up.
+ * @param encoder   encoder to check (24-27)
+ * @return 1 if encoder_set_quadrature() has enabled quadrature on it
+ */
+uint8_t encoder_is_quadrature(uint8_t encoder);
+
 #endif
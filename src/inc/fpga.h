@@ -44,18 +44,36 @@
 #define FPGA_MOTOR_SIZE     0x02
 #define FPGA_MOTOR_CTL      0x00
 #define FPGA_MOTOR_VEL      0x01
+// while set, motor writes are held back; clearing it applies them together
+#define FPGA_MOTOR_HOLD     0x3B
 
 // FPGA Encoder Registers
 #define FPGA_ENCODER_BASE   0x0C
 #define FPGA_ENCODER_SIZE   0x02
 #define FPGA_ENCODER_LO     0x00
 #define FPGA_ENCODER_HI     0x01
+#define FPGA_ENCODER_MODE   0x3A
+#define FPGA_ENCODER32_BASE 0x40
+#define FPGA_ENCODER32_SIZE 0x04
+#define FPGA_ENCODER_PERIOD_BASE 0x50
+#define FPGA_ENCODER_PERIOD_SIZE 0x04
+#define FPGA_ENCODER_PERIOD     0x00
+#define FPGA_ENCODER_AGE        0x02
+// unit of the period and age registers, in microseconds
+#define FPGA_ENCODER_PERIOD_US  16
+// writing the first snapshot register latches all four counters
+#define FPGA_ENCODER_SNAP_BASE  0x60
+#define FPGA_ENCODER_SNAP_TIME  0x00
+#define FPGA_ENCODER_SNAP_COUNT 0x04
+#define FPGA_ENCODER_SNAP_SIZE  0x14
 
 // FPGA Digital Register
 #define FPGA_DIGITAL_BASE   0x1E
 #define FPGA_DIGITAL_PWM_BASE   0x31
 #define FPGA_DIGITAL_SIZE   0x01
 #define FPGA_DIGITAL_PINMODE 0x30
+#define FPGA_DIGITAL_COUNT_BASE 0x80
+#define FPGA_DIGITAL_COUNT_SIZE 0x02
 
 // FPGA Servo Registers
 #define FPGA_SERVO_BASE     0x20
@@ -75,6 +93,10 @@
 #define fpga_get_version_major() fpga_read_byte(FPGA_VERSION_MAJ)
 /// Get the FPGA Minor Version. Not called by the user.
 #define fpga_get_version_minor() fpga_read_byte(FPGA_VERSION_MIN)
+/// True if the loaded FPGA image is at least version maj.min. Not called by the user.
+#define fpga_version_at_least(maj, min) \
+    (fpga_get_version_major() > (maj) || \
+     (fpga_get_version_major() == (maj) && fpga_get_version_minor() >= (min)))
 /// Initialise FPGA. Not called by the user.
 uint8_t fpga_init(uint16_t start, uint16_t len);
 
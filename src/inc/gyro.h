@@ -35,6 +35,16 @@
  * functions. Please see gyrotest for an example of correct gyro usage.
  * You will need to wait pause half a second before calling gyro_init (which
  * should be called in usetup).
+ *
+ * The gyro is sampled every millisecond by the background sampler and
+ * integrated (trapezoidal rule, fixed point) as each sample comes in, using
+ * the sample timestamps, so the heading does not depend on thread load.
+ *
+ * The zero-rate offset measured by gyro_init() is tracked during the match
+ * to follow temperature drift. Whenever the readings over a short window
+ * are quiet and close to the offset, and none of the drive motors are on,
+ * the offset is nudged toward the window's mean. gyro_set_hint() and
+ * gyro_set_drive_motors() tune the detection.
  */
 
 /**
@@ -49,12 +59,19 @@
  */
 void gyro_init (uint8_t port, float lsb_us_per_deg, uint32_t time_ms);
 
-/**
- * Internal routine for updating gyroscope. Don't call this unless you know what
- * you're doing.
- */
 #ifndef SIMULATE
-int gyro_update (void);
+/// Stationary hints, see gyro_set_hint()
+#define GYRO_HINT_AUTO          0
+#define GYRO_HINT_STATIONARY    1
+#define GYRO_HINT_MOVING        2
+
+/// Gyro sampling statistics, see gyro_get_stats()
+struct gyro_stats {
+    uint32_t samples;       ///< samples integrated
+    uint16_t dt_min_us;     ///< shortest time between samples
+    uint16_t dt_max_us;     ///< longest time between samples
+    uint16_t dt_avg_us;     ///< mean time between samples
+};
 #endif
 
 /**
@@ -73,6 +90,48 @@ float gyro_get_degrees (void);
  */
 #ifndef SIMULATE
 void gyro_set_degrees (float deg);
+
+/**
+ * Returns the current heading in degrees, in 24.8 fixed point (256 = 1
+ * degree). Avoids the floating point conversion of gyro_get_degrees().
+ */
+int32_t gyro_get_degrees_q8 (void);
+
+/**
+ * Copy the sampling statistics gathered since gyro_init() or the last
+ * gyro_reset_stats() into 'stats'. The spread between dt_min_us and
+ * dt_max_us is the sampling jitter.
+ */
+void gyro_get_stats (struct gyro_stats *stats);
+
+/** Restart gathering sampling statistics. */
+void gyro_reset_stats (void);
+
+/**
+ * Tell the bias tracker whether the robot is turning. With
+ * GYRO_HINT_STATIONARY the offset is updated from every window, with
+ * GYRO_HINT_MOVING never; GYRO_HINT_AUTO (default) decides from the
+ * readings and the drive motors.
+ */
+void gyro_set_hint (uint8_t hint);
+
+/**
+ * Set the motors (bit n for motor n) that move the robot. The offset is not
+ * updated while any of them is on. Defaults to all motors.
+ */
+void gyro_set_drive_motors (uint8_t mask);
+
+/** Returns the current zero-rate offset, in ADC LSBs. */
+float gyro_get_bias (void);
+
+/**
+ * Returns the variance of the readings over the last window, in LSB^2 with
+ * 4 fractional bits (16 = 1 LSB^2).
+ */
+uint16_t gyro_get_variance_q4 (void);
+
+/** Returns 1 if the last window was taken as not turning. */
+uint8_t gyro_is_stationary (void);
 #endif
 
 #endif // __INCLUDE_GYRO_H__
@@ -55,8 +55,10 @@ void spi_init(void);
 /**
  * Lock the SPI bus for access from a single thread.
  * spi_aquire() needs to be called before any communication on the
- * spi bus. spi_release() should be called after the communication
- * is complete.
+ * spi bus with spi_transfer_sync(). spi_release() should be called after
+ * the communication is complete. Queued transactions (spi_submit()) do
+ * not run while the bus is locked; spi_acquire() waits for the one in
+ * progress, if any.
  */
 int8_t spi_acquire();
 void   spi_release ();
@@ -68,6 +70,64 @@ void spi_set_master(spi_clk_div div, uint8_t flags);
 int8_t spi_transfer_sync (uint8_t * data, uint8_t len);
 int spi_try_acquire();
 
+/// Devices on the SPI bus, used to select a chip for a transaction
+typedef enum {
+    SPI_DEV_NONE,
+    SPI_DEV_ADC1,
+    SPI_DEV_ADC2,
+    SPI_DEV_MOTOR,
+    SPI_DEV_RF,
+    SPI_DEV_FLASH,
+} spi_device;
+
+/// Transaction states
+#define SPI_TXN_IDLE    0
+#define SPI_TXN_PENDING 1
+#define SPI_TXN_ACTIVE  2
+#define SPI_TXN_DONE    3
+
+/**
+ * An asynchronous SPI transaction: the device is selected, 'len' bytes from
+ * 'tx' are clocked out (zeros if 'tx' is NULL) while the received bytes are
+ * stored in 'rx' (dropped if NULL; 'rx' may equal 'tx'), then the device is
+ * deselected. The structure and buffers must stay valid until the
+ * transaction is done.
+ */
+struct spi_transaction {
+    spi_device dev;
+    spi_clk_div div;
+    uint8_t flags;
+    uint8_t *tx;
+    uint8_t *rx;
+    uint8_t len;
+    /// Called from interrupt context when the transaction completes. May
+    /// resubmit the transaction. Can be NULL.
+    void (*done)(struct spi_transaction *t);
+    /// Free for use by the submitter
+    void *user;
+    volatile uint8_t status;
+    struct spi_transaction *next;
+};
+
+/**
+ * Queue a transaction on the SPI bus and return immediately. Transactions
+ * run in order from the SPI interrupt, whenever the bus is not locked with
+ * spi_acquire(). Safe to call from interrupt handlers.
+ */
+void spi_submit(struct spi_transaction *t);
+
+/**
+ * Wait for a submitted transaction to complete. The calling thread sleeps
+ * while the transfer runs; with interrupts disabled, outside of a thread or
+ * while holding the SPI lock, the transfer is done by polling instead.
+ */
+void spi_wait(struct spi_transaction *t);
+
+/**
+ * Submit a transaction and wait for it to complete.
+ */
+void spi_transfer(struct spi_transaction *t);
+
 #endif
 
 #endif
@@ -15,6 +15,7 @@
 #include <rf.h>
 
 #include <nrf24l01.h>
+#include <sampler.h>
 
 #include <hal/adc.h>
 #include <hal/delay.h>
@@ -26,6 +27,7 @@
 #include <kern/global.h>
 #include <kern/isr.h>
 #include <kern/lock.h>
+#include <kern/periodic.h>
 #include <kern/thread.h>
 
 #ifndef SIMULATE
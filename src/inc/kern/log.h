@@ -0,0 +1,135 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SIMULATE
+
+#ifndef __INCLUDE_LOG_H__
+#define __INCLUDE_LOG_H__
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+/**
+ * \file log.h
+ * \brief Deferred-formatting binary logging.
+ *
+ * The log_*() macros do not format anything on the board. Each call stores
+ * the flash address of its format string, a millisecond timestamp and the raw
+ * argument bytes into a ring buffer, which costs a few hundred cycles instead
+ * of a full vfprintf. The buffer is drained to the UART by the transmit
+ * interrupt, between printf() calls, and tools/logdecode.py turns the records
+ * back into text using the format strings stored in the OS .elf file.
+ *
+ * Calls below LOG_LEVEL are removed at compile time. Define LOG_LEVEL before
+ * including this file (or with -DLOG_LEVEL=...) to change it.
+ *
+ * \code
+ * log_info("pid out %d err %ld", out, err);
+ * \endcode
+ *
+ * Supported conversions are those of printf(): integers (with the 'l'
+ * modifier for 32 bit values), %c, %p, floats, %s (copied, at most
+ * LOG_STR_MAX characters) and %S (program memory strings).
+ */
+
+#define LOG_LEVEL_NONE      0
+#define LOG_LEVEL_ERROR     1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_INFO      3
+#define LOG_LEVEL_DEBUG     4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/// Maximum number of argument bytes in a single record
+#define LOG_ARGS_MAX        24
+/// Maximum number of characters copied for a %s argument
+#define LOG_STR_MAX         16
+
+/// First byte of every record on the wire
+#define LOG_SYNC            0xA5
+/// Record header: sync, level, argument length, format id (2), time (4)
+#define LOG_HDR_SIZE        9
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define log_error(fmt, ...) log_write_P(LOG_LEVEL_ERROR, PSTR(fmt), ## __VA_ARGS__)
+#else
+#define log_error(fmt, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define log_warn(fmt, ...) log_write_P(LOG_LEVEL_WARN, PSTR(fmt), ## __VA_ARGS__)
+#else
+#define log_warn(fmt, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define log_info(fmt, ...) log_write_P(LOG_LEVEL_INFO, PSTR(fmt), ## __VA_ARGS__)
+#else
+#define log_info(fmt, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define log_debug(fmt, ...) log_write_P(LOG_LEVEL_DEBUG, PSTR(fmt), ## __VA_ARGS__)
+#else
+#define log_debug(fmt, ...) do {} while (0)
+#endif
+
+/**
+ * Initialize the log buffer. Should not be called by user.
+ */
+void log_init(void);
+
+/**
+ * Queue a log record. Use the log_*() macros instead of calling this
+ * directly. Safe to call from threads and from interrupt handlers; if the
+ * buffer is full the record is dropped and counted.
+ *
+ * @param level Level of the record (LOG_LEVEL_*).
+ * @param fmt   printf() style format string in program memory.
+ */
+void log_write_P(uint8_t level, PGM_P fmt, ...);
+
+/**
+ * Return the number of records dropped because the buffer was full.
+ */
+uint16_t log_get_dropped(void);
+
+/**
+ * Start draining the buffer if the UART is free. Called by the UART driver
+ * when it releases the port. Should not be called by user.
+ */
+void log_kick(void);
+
+/**
+ * Wait until the UART is not in the middle of a log record. Called by the
+ * UART driver before sending a character. Should not be called by user.
+ */
+void log_uart_claim(void);
+
+#endif // __INCLUDE_LOG_H__
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SIMULATE
+
+#ifndef __INCLUDE_PERIODIC_H__
+#define __INCLUDE_PERIODIC_H__
+
+#include <stdint.h>
+
+/**
+ * \file periodic.h
+ * \brief Periodic tasks.
+ *
+ * Runs short functions at a fixed rate from a single kernel thread, so that
+ * background services (motor monitoring, control loops, display refresh)
+ * don't each need a thread and a stack of their own.
+ *
+ * Tasks run one after another on the periodic thread's stack. They must be
+ * short and must not block for long; a task that pauses delays every other
+ * task. If a task falls behind by more than a period, the missed runs are
+ * skipped rather than run back to back.
+ *
+ * \code
+ * static struct periodic_task blink_task;
+ *
+ * void blink(void *arg) {
+ *     ...
+ * }
+ *
+ * periodic_add(&blink_task, blink, NULL, 100);
+ * \endcode
+ */
+
+/// Longest the periodic thread sleeps between checks, in milliseconds
+#define PERIODIC_MAX_SLEEP  10
+
+/**
+ * A periodic task. The structure is owned by the caller and must stay valid
+ * until the task is removed.
+ */
+struct periodic_task {
+    void (*fn)(void *arg);          ///< function to run
+    void *arg;                      ///< argument passed to fn
+    uint16_t period;                ///< period in milliseconds
+    uint32_t due;                   ///< time of the next run
+    struct periodic_task *next;     ///< next task in the list
+};
+
+/**
+ * Initialize the task list. Should not be called by user.
+ */
+void periodic_init(void);
+
+/**
+ * Start the periodic thread. Should not be called by user.
+ */
+void periodic_start(void);
+
+/**
+ * Run fn(arg) every period milliseconds, starting as soon as possible. May
+ * be called before the periodic thread is started.
+ *
+ * @param task      Task structure to use.
+ * @param fn        Function to run.
+ * @param arg       Argument passed to fn.
+ * @param period    Period in milliseconds.
+ */
+void periodic_add(struct periodic_task *task, void (*fn)(void *), void *arg,
+        uint16_t period);
+
+/**
+ * Stop running a task. Does nothing if the task is not running. May be
+ * called from the task itself.
+ *
+ * @param task  Task to remove.
+ */
+void periodic_remove(struct periodic_task *task);
+
+#endif // __INCLUDE_PERIODIC_H__
+
+#endif
@@ -167,6 +167,46 @@ void pause(uint32_t ms);
  */
 void yield(void);
 
+#ifndef SIMULATE
+
+/**
+ * Put the current thread to sleep on 'chan' until another thread or an
+ * interrupt handler calls thread_wakeup() with the same channel. Must be
+ * called with interrupts disabled; check the condition being waited for,
+ * then sleep, all without re-enabling interrupts, so that a wakeup cannot
+ * be missed. Returns with interrupts still disabled.
+ *
+ * \code
+ * ATOMIC_BEGIN;
+ * while (!done)
+ *     thread_sleep(&done);
+ * ATOMIC_END;
+ * \endcode
+ *
+ * @param chan  Any address identifying the event, usually the object waited on.
+ */
+void thread_sleep(void *chan);
+
+/**
+ * Like thread_sleep(), but give up after 'ms' milliseconds. Must be called
+ * with interrupts disabled, and returns with them still disabled.
+ *
+ * @param chan  Any address identifying the event.
+ * @param ms    Longest time to sleep, in milliseconds.
+ * @return 1 if woken by thread_wakeup(), 0 if the timeout expired.
+ */
+uint8_t thread_sleep_timeout(void *chan, uint32_t ms);
+
+/**
+ * Make runnable every thread sleeping on 'chan'. Safe to call from
+ * interrupt handlers.
+ *
+ * @param chan  Channel passed to thread_sleep() or thread_sleep_timeout().
+ */
+void thread_wakeup(void *chan);
+
+#endif
+
 /**
  * Terminate and exit the current thread.
  * This will free the thread's stack space, but not any of it's dynamically
@@ -72,6 +72,11 @@
  * lcd_set_custom_char() function, as long as you remember this will change the
  * OS warning indicator icons.
  *
+ * Printing only updates a copy of the display in memory, so it doesn't hold
+ * up the calling thread. A background task sends the changed characters to
+ * the display, a nibble at a time, and a full redraw takes around 150ms. Use
+ * lcd_flush() to wait until the display is up to date.
+ *
  */
 
 #ifndef SIMULATE
@@ -113,6 +118,12 @@ void lcd_set_custom_char(uint8_t chnum,uint8_t *data);
  */
 void lcd_write_data(uint8_t data);
 
+/**
+ * Wait until the display shows everything printed so far. Busy-waits on the
+ * display, so it should rarely be needed.
+ */
+void lcd_flush(void);
+
 /**
  * Display a string to the LCD.
  *
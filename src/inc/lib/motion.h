@@ -47,7 +47,7 @@
 typedef struct {
     int32_t position;           ///< current encoder position
     uint8_t encoder;            ///< encoder port to read from
-    uint16_t encoder_old_pos;   ///< old encoder position
+    int32_t encoder_old_pos;    ///< old encoder position
     MotorGroup output;          ///< MotorGroup to drive
     struct pid_controller pid;  ///< PID controller
 } MotionController;
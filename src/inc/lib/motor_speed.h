@@ -0,0 +1,104 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef MOTOR_SPEED_H
+#define MOTOR_SPEED_H
+
+#include <kern/global.h>
+
+/**
+ * \file motor_speed.h
+ * \brief Closed-loop motor speed control
+ *
+ * Runs a velocity PID loop for each configured motor, using the speed
+ * measured by the motor's shaft encoder. All the loops run every
+ * MOTOR_SPEED_PERIOD milliseconds from the kernel's periodic thread, so they
+ * need no threads of their own.
+ *
+ * The drive value is kf * target plus the PID output, limited to
+ * [-255, 255]. kf is the feed-forward gain: roughly 255 divided by the speed
+ * of the unloaded motor at full drive. With a good kf the PID only has to
+ * correct for load.
+ *
+ * Negative speeds are fine with any encoder. A quadrature encoder (see
+ * encoder_set_quadrature()) measures the direction itself. A plain encoder
+ * only counts up, so its speed is taken to have the sign of the last drive
+ * value. That is right except briefly while the motor reverses.
+ *
+ * \code
+ * motor_speed_init(0, 24, 0.5, 0.2, 0.5, 0);
+ * motor_set_speed(0, 300);   // 300 ticks per second
+ * \endcode
+ *
+ * Not available in simulation.
+ */
+
+#ifndef SIMULATE
+
+/// Period of the speed loops, in milliseconds
+#define MOTOR_SPEED_PERIOD  10
+
+/**
+ * Put a motor under speed control. The motor coasts until motor_set_speed()
+ * is called.
+ *
+ * @param motor     Motor port
+ * @param encoder   Encoder port (24-27) measuring the motor
+ * @param kf        Feed-forward gain, drive per tick/s
+ * @param kp        Proportional constant for PID
+ * @param ki        Integral constant for PID
+ * @param kd        Derivative constant for PID
+ */
+void motor_speed_init(uint8_t motor, uint8_t encoder,
+        float kf, float kp, float ki, float kd);
+
+/**
+ * Set the target speed of a motor under speed control. A target of 0 lets
+ * the motor coast.
+ *
+ * @param motor     Motor port
+ * @param speed     Target speed in encoder ticks per second
+ */
+void motor_set_speed(uint8_t motor, int32_t speed);
+
+/**
+ * Return the speed of a motor under speed control, as last measured by its
+ * loop, in encoder ticks per second.
+ *
+ * @param motor     Motor port
+ */
+int32_t motor_get_speed(uint8_t motor);
+
+/**
+ * Take a motor off speed control and let it coast. motor_set_vel() can be
+ * used again afterwards.
+ *
+ * @param motor     Motor port
+ */
+void motor_speed_disable(uint8_t motor);
+
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef POSE_H
+#define POSE_H
+
+#include <kern/global.h>
+
+/**
+ * \file pose.h
+ * \brief VPS pose prediction
+ *
+ * VPS positions are tens of milliseconds old by the time the RF thread
+ * receives them, and a new one only arrives every few hundred milliseconds.
+ * This module timestamps each VPS fix and carries it forward to the present
+ * using the gyro heading and, if the robot has them, quadrature encoders on
+ * the drive wheels. Plain encoders count up whichever way the wheel turns,
+ * so they can't be used for odometry.
+ *
+ * Every POSE_PERIOD milliseconds the periodic thread integrates the
+ * encoder distance along the gyro heading and keeps a short history of
+ * the result. When a fix arrives, the module looks up where the robot was
+ * at the time of the fix (its arrival time minus the VPS latency). The
+ * predicted pose is the fix plus the movement since then, rotated from
+ * the gyro's frame into the VPS frame. The gyro therefore does not need to
+ * be synchronised with the VPS heading.
+ *
+ * \code
+ * // quadrature encoders on pins 0/1 and 2/3, mounted mirror image
+ * pose_init(24, 26, 0.8, -0.8);
+ * ...
+ * struct pose p;
+ * if (get_predicted_pose(&p))
+ *     printf("%.0f %.0f %.1f\n", p.x, p.y, p.theta);
+ * \endcode
+ *
+ * The gyro must be initialised first. Not available in simulation.
+ */
+
+#ifndef SIMULATE
+
+/// Period of the odometry update, in milliseconds
+#define POSE_PERIOD         10
+/// Number of odometry samples kept to look up the pose at a fix
+#define POSE_HISTORY        12
+/// Encoder port value meaning "no encoder"
+#define POSE_NO_ENCODER     0xFF
+/// Default VPS latency, in milliseconds
+#define POSE_VPS_LATENCY_DEFAULT    0
+
+/// A robot pose in VPS coordinates
+struct pose {
+    float x;        ///< x position, in VPS units
+    float y;        ///< y position, in VPS units
+    float theta;    ///< heading in degrees, 0 to 360
+};
+
+/**
+ * Start tracking the robot's pose. Either encoder may be POSE_NO_ENCODER;
+ * with neither, only the heading is predicted and the position is that of
+ * the last fix. gyro_set_degrees() moves the gyro's frame, so call this
+ * again after it; predictions resume with the next fix.
+ *
+ * The encoders are switched to quadrature mode (see
+ * encoder_set_quadrature()), which resets them.
+ *
+ * @param left_encoder      Quadrature encoder (24 or 26) on the left wheel
+ * @param right_encoder     Quadrature encoder (24 or 26) on the right wheel
+ * @param left_scale        VPS units travelled forward per left encoder
+ *                          count; negative if the count decreases when
+ *                          the wheel drives forward
+ * @param right_scale       VPS units travelled forward per right encoder count
+ * @return 0 on success, -1 if an encoder can't be decoded as quadrature
+ *         (not 24 or 26, or no FPGA support); the settings are unchanged.
+ */
+int8_t pose_init(uint8_t left_encoder, uint8_t right_encoder,
+        float left_scale, float right_scale);
+
+/**
+ * Set the age of VPS fixes when they arrive: the time from the camera
+ * frame to the packet reaching the robot. Defaults to
+ * POSE_VPS_LATENCY_DEFAULT.
+ *
+ * @param ms    Latency in milliseconds, at most
+ *              (POSE_HISTORY - 1) * POSE_PERIOD to be useful.
+ */
+void pose_set_vps_latency(uint16_t ms);
+
+/**
+ * Get the current pose, predicted from the last VPS fix.
+ *
+ * @param p     Where to store the pose.
+ * @return 1 on success, 0 if no fix has arrived yet (p is unchanged).
+ */
+uint8_t get_predicted_pose(struct pose *p);
+
+#endif
+
+#endif
@@ -28,6 +28,8 @@
 #ifndef _MCP3008_H_
 #define _MCP3008_H_
 
+#include <hal/spi.h>
+
 typedef enum {
     MCP3008_MOTOR,
     MCP3008_ADC1,
@@ -59,6 +61,17 @@ typedef enum {
 void init_mcp3008 (void);
 int8_t mcp3008_get_sample (mcp3008_device dev, mcp3008_input config, uint16_t * sample);
 
+/**
+ * Fill in the device, bus setup and command of an SPI transaction that
+ * samples 'config' on 'dev'. The caller sets up rx, done and user.
+ *
+ * @param cmd   3 byte command buffer, used as the transaction's tx buffer.
+ */
+void mcp3008_prepare (struct spi_transaction *t, mcp3008_device dev, mcp3008_input config, uint8_t *cmd);
+
+/** Extract the 10 bit sample from the 3 bytes received by a transaction. */
+uint16_t mcp3008_decode (uint8_t *rx);
+
 #endif
 
 #endif
@@ -26,6 +26,8 @@
 #ifndef _MOTOR_H_
 #define _MOTOR_H_
 
+#include <stdint.h>
+
 #ifndef SIMULATE
 #define MOTOR_0     0
 #define MOTOR_1     1
@@ -51,7 +53,29 @@
  * Each motor port has a current sensor associated with it, allowing the robot to sense the
  * current usage of each motor. Motor current increases proportional to torque and thus can
  * be used to sense when a motor has stalled (driving into a wall, other robots, etc).
+ *
+ * The currents of the driven motors are checked every 5ms in the background. A motor whose
+ * current stays above its stall threshold for 40ms is reported as stalled, through
+ * motor_get_stalled() and to any handlers registered with motor_stall_subscribe(). A motor
+ * can also be given a current limit, above which its PWM is scaled down until the current
+ * drops again.
+ */
+
+#ifndef SIMULATE
+/// Default stall threshold, in milliamps
+#define MOTOR_STALL_DEFAULT_MA  1200
+/// Maximum number of stall handlers
+#define MOTOR_STALL_HANDLERS    4
+
+/**
+ * Stall handler. Called from the monitor when a motor starts or stops being
+ * stalled. Runs on the periodic thread, so it must not block.
+ *
+ * @param motor     Motor port.
+ * @param stalled   1 if the motor has stalled, 0 if it is no longer stalled.
  */
+typedef void (*motor_stall_handler)(uint8_t motor, uint8_t stalled);
+#endif
 
 /** Initialize motors. Should not be called by user. */
 void motor_init(void);
@@ -65,6 +89,16 @@ void motor_init(void);
  */
 void motor_set_vel(uint8_t motor, int16_t vel);
 
+/**
+ * Set the velocities of several motors at once. Registers that already hold
+ * the right value are not rewritten, and with FPGA version 0.11 and later all
+ * the motors change on the same clock cycle.
+ *
+ * @param mask  Bit n set to set motor n.
+ * @param vels  Velocities, indexed by motor port (vels[n] for motor n).
+ */
+void motor_set_vels(uint8_t mask, const int16_t *vels);
+
 /**
  * Set a motor to brake (stops the motor as quickly as possible).
  * Calling motor_set_vel() again will disable the brake state.
@@ -85,6 +119,15 @@ void motor_brake(uint8_t motor);
 uint16_t motor_get_current(uint8_t motor);
 #endif
 
+/**
+ * Return a bitmask of the motors that are driven, i.e. were last set to a
+ * non-zero velocity (bit n for motor n). Safe to call from interrupt
+ * handlers.
+ */
+#ifndef SIMULATE
+uint8_t motor_get_active(void);
+#endif
+
 /**
  * Read the current in a given motor in milliamps.
  *
@@ -95,4 +138,60 @@ uint16_t motor_get_current(uint8_t motor);
 uint16_t motor_get_current_MA(uint8_t motor);
 #endif
 
+/**
+ * Set the current above which a driven motor counts as stalled. The default
+ * is MOTOR_STALL_DEFAULT_MA.
+ *
+ * @param motor Motor port.
+ * @param ma    Threshold in milliamps, or 0 to disable stall detection.
+ */
+#ifndef SIMULATE
+void motor_set_stall_current(uint8_t motor, uint16_t ma);
+#endif
+
+/**
+ * Limit the current of a motor by scaling down its PWM while the current is
+ * above the limit. Off by default.
+ *
+ * @param motor Motor port.
+ * @param ma    Limit in milliamps, or 0 for no limit.
+ */
+#ifndef SIMULATE
+void motor_set_current_limit(uint8_t motor, uint16_t ma);
+#endif
+
+/**
+ * Compensate motor commands for battery sag. While enabled, every motor's
+ * PWM duty is scaled by nominal_mv divided by the filtered battery voltage
+ * (limited to 0.75x to 1.5x), so a given motor_set_vel() value gives about
+ * the same speed on a fresh pack as on a drained one. Commands that would
+ * need more than full duty after scaling are limited to full duty. Off by
+ * default.
+ *
+ * @param nominal_mv    Voltage the motor values are meant for (e.g. the
+ *                      voltage PID gains were tuned at), in millivolts, or 0
+ *                      to turn compensation off.
+ */
+#ifndef SIMULATE
+void motor_set_battery_compensation(uint16_t nominal_mv);
+#endif
+
+/**
+ * Return a bitmask of the motors that are currently stalled (bit n for
+ * motor n).
+ */
+#ifndef SIMULATE
+uint8_t motor_get_stalled(void);
+#endif
+
+/**
+ * Register a function to be called when a motor stalls or recovers.
+ *
+ * @param handler   Function to call.
+ * @return 0 on success, -1 if MOTOR_STALL_HANDLERS handlers are registered.
+ */
+#ifndef SIMULATE
+int8_t motor_stall_subscribe(motor_stall_handler handler);
+#endif
+
 #endif
@@ -192,11 +192,22 @@
 #define NRF_SPI_W_TX_PAYLOAD_NOACK  0xB0
 #define NRF_SPI_NOP                 0xFF
 
+/**
+ * Start a session on the nRF: lock the SPI bus and set it up for the
+ * radio. The nrf_*() calls made until nrf_end() share the session, which
+ * saves locking and configuring the bus for each of them. Sessions nest.
+ * Don't hold a session while waiting for the radio, it keeps every other
+ * SPI device off the bus.
+ */
+void nrf_begin(void);
+void nrf_end(void);
+
 uint8_t nrf_read_status(void);
 uint8_t nrf_read_reg(uint8_t reg);
 uint8_t nrf_read_multibyte_reg(uint8_t reg, uint8_t *data, uint8_t len);
 uint8_t nrf_write_reg(uint8_t reg, uint8_t data);
 uint8_t nrf_write_multibyte_reg(uint8_t reg, uint8_t *data, uint8_t len);
+
 uint8_t nrf_read_rx_payload(uint8_t *data, uint8_t len);
 uint8_t nrf_read_rx_payload_len();
 uint8_t nrf_write_tx_payload(uint8_t *data, uint8_t len);
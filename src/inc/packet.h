@@ -15,7 +15,8 @@ enum {
     START, //Start of the round
     STOP, //End of the round
     STRING, //String from bot to board
-    REPLY_STRING //String from board to bot
+    REPLY_STRING, //String from board to bot
+    TELEMETRY //Link statistics from bot to board
 } packet_type;
 
 #endif
@@ -43,13 +43,167 @@ int rf_vscanf_P(const char *fmt, va_list ap);
 int rf_scanf_P(const char *fmt, ...);
 uint8_t rf_has_char();
 
+/// Number of packets that can wait to be sent, a power of two
+#define RF_TX_QUEUE_SIZE 4
+
 /**
- * Transmits a packet
+ * Transmits a packet, waiting until it has been sent. The radio can't
+ * receive in the meantime, so prefer rf_queue_packet().
+ * @return 1 if the packet was sent.
  */
 uint8_t rf_send_packet(uint8_t address, uint8_t *data, uint8_t len);
 
+/**
+ * Queue a packet for the RF thread to send, and return at once. Queued
+ * packets are sent together, in a single switch out of receive mode.
+ * rf_printf() output is sent this way. If the queue is full the caller
+ * sleeps until there is room.
+ * @param address   Low byte of the destination address.
+ * @param data      Packet to send, copied into the queue.
+ * @param len       Length of the packet, at most sizeof(packet_buffer).
+ * @return 0 on success, -1 if the packet is too long or could not be queued.
+ */
+int8_t rf_queue_packet(uint8_t address, uint8_t *data, uint8_t len);
+
+/**
+ * Copy the latest VPS data into 'game' and 'position_microtime'. Never
+ * blocks the RF thread; if an update arrives during the copy, the copy is
+ * redone.
+ */
 void copy_objects();
 
+/**
+ * Take a consistent copy of the latest VPS data, without touching the
+ * global 'game'.
+ * @param data      Where to copy the game data.
+ * @param time_us   Where to store the time the data arrived (get_time_us()),
+ *                  or NULL.
+ * @return A sequence number that changes with every update.
+ */
+uint8_t game_read(game_data *data, uint32_t *time_us);
+
+/**
+ * Take a consistent copy of our robot's last VPS position. Unlike
+ * game_read(), only packets that actually contain our position count as a
+ * fix; the others keep the previous position.
+ * @param coord     Where to copy our coordinates.
+ * @param time_ms   Where to store the time the fix arrived (get_time()).
+ * @return A count of fixes that changes with every new one, or 0 if there
+ *         has been no fix yet.
+ */
+uint8_t game_read_fix(board_coord *coord, uint32_t *time_ms);
+
+/**
+ * Sleep until new VPS data arrives, then copy it into 'game' as
+ * copy_objects() does.
+ * @param timeout   Longest time to wait, in milliseconds.
+ * @return 1 if new data arrived, 0 if the timeout expired first.
+ */
+uint8_t game_wait_update(uint32_t timeout);
+
+/// Number of base station boards, from packet_buffer.board
+#define RF_SOURCES          4
+/// Number of buckets in the packet interval histogram
+#define RF_INTERVAL_BUCKETS 8
+/// Upper edge of the first interval bucket in ms; each bucket is twice as wide
+#define RF_INTERVAL_MIN     8
+
+/// Link statistics for packets from one base station board
+struct rf_link_stats {
+    uint16_t received;      ///< packets received
+    uint16_t lost;          ///< packets missing from the sequence numbers
+    uint16_t duplicates;    ///< packets repeated or out of order
+    /// Time between packets: bucket i counts intervals below
+    /// RF_INTERVAL_MIN << i ms, the last bucket counts the rest
+    uint16_t intervals[RF_INTERVAL_BUCKETS];
+};
+
+/// Payload of a TELEMETRY packet, sent by rf_send_link_stats()
+struct rf_telemetry {
+    struct rf_link_stats stats;
+    uint8_t robot_id;
+    uint16_t oversize;
+    uint16_t tx_failures;
+} __attribute__ ((packed));
+
+/**
+ * Get the link statistics for packets from one board. Sequence number
+ * gaps only show losses between packets that did arrive.
+ * @param board     Board number, 0 to RF_SOURCES-1.
+ * @param stats     Where to copy the statistics.
+ */
+void rf_get_link_stats(uint8_t board, struct rf_link_stats *stats);
+
+/**
+ * Return the number of received payloads thrown away for being too long.
+ */
+uint16_t rf_get_oversize_count(void);
+
+/**
+ * Return the number of transmissions that were never acknowledged. Only
+ * counts with auto-ack enabled (see rf_set_auto_ack()).
+ */
+uint16_t rf_get_tx_failures(void);
+
+/**
+ * Clear all link statistics.
+ */
+void rf_reset_link_stats(void);
+
+/**
+ * Queue a TELEMETRY packet with the statistics for one board, plus the
+ * oversize and transmit failure counts. The payload is a struct
+ * rf_telemetry.
+ * @param board     Board number, 0 to RF_SOURCES-1.
+ * @return 0 on success, -1 if the packet could not be queued.
+ */
+int8_t rf_send_link_stats(uint8_t board);
+
+/// Highest RF channel; channel n is at 2400+n MHz
+#define RF_CHANNEL_MAX  125
+/// 1Mbps air data rate, for rf_set_data_rate()
+#define RF_RATE_1MBPS   1
+/// 2Mbps air data rate, for rf_set_data_rate()
+#define RF_RATE_2MBPS   2
+
+/*
+ * Radio settings. The defaults (channel 2, 1Mbps, fixed size payloads, no
+ * auto-ack) match the VPS base stations; only change them if the other end
+ * is set up the same way. Each call rewrites the radio configuration, which
+ * takes a couple of milliseconds, and drops anything in the receive FIFO.
+ */
+
+/**
+ * Select the RF channel.
+ * @param channel   Channel, 0 to RF_CHANNEL_MAX.
+ */
+void rf_set_channel(uint8_t channel);
+
+/**
+ * Select the air data rate. 2Mbps halves the time on air, and so the
+ * chance of a collision, at the cost of some range.
+ * @param rate  RF_RATE_1MBPS or RF_RATE_2MBPS.
+ */
+void rf_set_data_rate(uint8_t rate);
+
+/**
+ * Enable dynamic payload length on pipe 0, so packets are only as long as
+ * their contents. The nRF24L01 requires auto-ack on a pipe for dynamic
+ * payloads, so this also enables auto-ack on pipe 0: received packets are
+ * acknowledged, but sent packets are only retried if rf_set_auto_ack()
+ * asks for retries.
+ * @param enable    1 to enable, 0 for fixed sizeof(packet_buffer) payloads.
+ */
+void rf_set_dynamic_payload(uint8_t enable);
+
+/**
+ * Enable auto-acknowledge for packets sent by the robot. The radio resends
+ * a packet that isn't acknowledged, every 500us, up to 'retries' times,
+ * and rf_send_packet() reports whether it got through.
+ * @param retries   Number of retransmits (at most 15), 0 to disable auto-ack.
+ */
+void rf_set_auto_ack(uint8_t retries);
+
 extern volatile uint8_t robot_id;
 
 /**
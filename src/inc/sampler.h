@@ -0,0 +1,179 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SIMULATE
+
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include <stdint.h>
+#include <mcp3008.h>
+
+/**
+ * \file sampler.h
+ * \brief Background ADC sampling.
+ *
+ * The sampler scans the channels of the three MCP3008 ADCs (the analog
+ * ports on ADC1 and ADC2, and the motor current / battery channels on the
+ * MOTOR ADC) in the background, each at its own rate. Conversions are
+ * started from the 1ms system tick and run on the SPI transaction queue,
+ * so no thread waits for them. Results go into a snapshot table of values
+ * and timestamps that can be read at any time in constant time.
+ *
+ * Each channel can also run a short chain of fixed-point filter stages
+ * (sampler_add_filter()) on every sample, in the interrupt. Their output is
+ * kept next to the raw value in the table.
+ *
+ * Channels are numbered SAMPLER_CHANNEL(dev, input), with 'input' the
+ * single-ended input (0..7) of the ADC. analog_read() uses the sampler and
+ * enables the channel of a port on first use, so most code never needs to
+ * call these functions directly.
+ */
+
+/// Number of sampler channels (8 per ADC)
+#define SAMPLER_CHANNELS        24
+
+/// Channel number of single-ended 'input' (0..7) of ADC 'dev'
+#define SAMPLER_CHANNEL(dev, input) ((dev)*8 + (input))
+
+/// Sample period (ms) used for channels enabled on first read
+#define SAMPLER_DEFAULT_PERIOD  5
+
+/// Maximum number of filter stages on a channel
+#define SAMPLER_FILTER_STAGES   4
+
+/// Filter stage types, see sampler_add_filter()
+enum {
+    SAMPLER_FILTER_AVERAGE,     ///< moving average of 'param' (2..16) samples
+    SAMPLER_FILTER_MEDIAN,      ///< median of the last 'param' (3, 5 or 7) samples
+    SAMPLER_FILTER_EMA,         ///< exponential smoothing, 'param' = SAMPLER_EMA_ALPHA(a)
+    SAMPLER_FILTER_DECIMATE,    ///< pass one sample out of 'param'
+    SAMPLER_FILTER_OVERSAMPLE,  ///< sum 4^'param' samples into 'param' (1..3) extra bits
+};
+
+/// Smoothing factor (0 < a < 1) of an EMA stage, as a Q8 constant
+#define SAMPLER_EMA_ALPHA(a)    ((uint8_t)((a)*256))
+
+/// A sample and the time (get_time_us()) at which it was taken
+struct sampler_entry {
+    uint16_t value;             ///< raw 10 bit sample
+    uint16_t filtered;          ///< output of the channel's filters
+    uint32_t time_us;
+};
+
+/**
+ * Called from interrupt context for every new sample of a channel. Keep it
+ * short.
+ */
+typedef void (*sampler_callback)(uint8_t ch, uint16_t value, uint32_t time_us);
+
+/**
+ * Initialize the sampler. Should not be called by user.
+ */
+void sampler_init(void);
+
+/**
+ * Called from the system tick to start due conversions. Should not be
+ * called by user.
+ */
+void sampler_tick(void);
+
+/**
+ * Sample channel 'ch' every 'period_ms' milliseconds, starting now. A
+ * period of 0 disables the channel.
+ */
+void sampler_enable(uint8_t ch, uint16_t period_ms);
+
+/** Stop sampling channel 'ch'. Its last value stays in the table. */
+void sampler_disable(uint8_t ch);
+
+/**
+ * Register a function to call on every new sample of channel 'ch', or
+ * NULL to remove it.
+ */
+void sampler_set_callback(uint8_t ch, sampler_callback fn);
+
+/**
+ * Append a filter stage to the chain of channel 'ch'. Stages run in the
+ * order they were added, each on the output of the one before; decimating
+ * stages (DECIMATE, OVERSAMPLE) only pass some samples on. The filtered
+ * value of a channel without stages is its raw value.
+ *
+ * \code
+ * // 12 bit readings, with spikes removed
+ * sampler_add_filter(ch, SAMPLER_FILTER_OVERSAMPLE, 1);
+ * sampler_add_filter(ch, SAMPLER_FILTER_MEDIAN, 3);
+ * \endcode
+ *
+ * @param ch    Channel to filter.
+ * @param type  Stage type (SAMPLER_FILTER_*).
+ * @param param Stage parameter, see the stage types.
+ * @return 0 on success, -1 if the parameter is out of range or the chain is full.
+ */
+int8_t sampler_add_filter(uint8_t ch, uint8_t type, uint8_t param);
+
+/** Remove all filter stages from channel 'ch'. */
+void sampler_clear_filters(uint8_t ch);
+
+/**
+ * Return the latest filtered value of channel 'ch'. Like sampler_read(),
+ * enables the channel if needed.
+ */
+uint16_t sampler_read_filtered(uint8_t ch);
+
+/**
+ * Return the latest sample of channel 'ch'. If the channel is not being
+ * sampled it is enabled at SAMPLER_DEFAULT_PERIOD, and the call waits for
+ * the first sample.
+ */
+uint16_t sampler_read(uint8_t ch);
+
+/**
+ * Wait for and return a sample of channel 'ch' started after the call.
+ */
+uint16_t sampler_read_fresh(uint8_t ch);
+
+/**
+ * Copy the latest sample of channel 'ch' and its timestamp into 'e'.
+ * Returns 0 if the channel has not been sampled yet.
+ */
+uint8_t sampler_get_entry(uint8_t ch, struct sampler_entry *e);
+
+/**
+ * Copy the whole table (SAMPLER_CHANNELS entries) into 'table'. The copy
+ * is consistent: it is the table as it was at a single point in time.
+ */
+void sampler_get_snapshot(struct sampler_entry *table);
+
+/**
+ * Copy the latest values of channels first..first+n-1 into 'values', taken
+ * from the table at a single point in time. Unlike sampler_read(), does not
+ * enable the channels; channels that have not been sampled read as 0.
+ */
+void sampler_get_values(uint8_t first, uint8_t n, uint16_t *values);
+
+#endif
+
+#endif
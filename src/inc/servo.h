@@ -42,8 +42,21 @@
  * Each servo has a 9bit register used to set it's position. Setting the servo to 0 will
  * cause it to move to its counter-clockwise limit, while setting it to 511, will cause
  * it to move to its clockwise limit.
+ *
+ * servo_move_to() moves a servo smoothly instead of jumping: the position is
+ * interpolated in the background every SERVO_UPDATE_PERIOD milliseconds,
+ * within the servo's velocity and acceleration limits (servo_set_limits())
+ * and its range (servo_set_range()). The call returns at once; use
+ * servo_wait() or servo_is_moving() to find out when the servo arrives.
+ * servo_set_pos() is a move with no duration, which is immediate unless
+ * limits are set.
  */
 
+#ifndef SIMULATE
+/// Interval between servo position updates, in milliseconds
+#define SERVO_UPDATE_PERIOD 20
+#endif
+
 /** Initialize servos. Should not be called by user. */
 #ifndef SIMULATE
 void servo_init(void);
@@ -64,6 +77,73 @@ void servo_set_pos(uint8_t servo, uint16_t pos);
  * @param servo Servo to disable
  */
 void servo_disable(uint8_t servo);
+
+/**
+ * Limit the positions a servo can be set to. Positions outside the range
+ * are clamped to it. The default range is 0..511.
+ *
+ * @param servo Servo to set.
+ * @param lower Lowest position (0..511)
+ * @param upper Highest position (0..511)
+ */
 void servo_set_range(uint8_t servo, uint16_t lower, uint16_t upper);
 
+#ifndef SIMULATE
+
+/**
+ * Set a servo's position directly in FPGA units (3.875us), bypassing the
+ * range and the motion engine. Should not normally be called by user.
+ *
+ * @param servo Servo to set.
+ * @param pos   Pulse width (0..1023)
+ */
+void servo_set_pos_raw(uint8_t servo, uint16_t pos);
+
+/**
+ * Start moving a servo to a new position, taking at least 'duration'
+ * milliseconds. Returns immediately.
+ *
+ * @param servo     Servo to move.
+ * @param pos       Target position (0..511)
+ * @param duration  Time the move should take in milliseconds, or 0 to move
+ *                  as fast as the servo's limits allow.
+ */
+void servo_move_to(uint8_t servo, uint16_t pos, uint16_t duration);
+
+/**
+ * Limit how fast a servo moves. Applies to servo_move_to() and
+ * servo_set_pos().
+ *
+ * @param servo     Servo to set.
+ * @param max_vel   Maximum speed in positions per second, or 0 for no limit.
+ * @param max_acc   Maximum acceleration in positions per second squared, or
+ *                  0 for no limit.
+ */
+void servo_set_limits(uint8_t servo, uint16_t max_vel, uint16_t max_acc);
+
+/**
+ * Return the position a servo has been commanded to so far (0..511). While a
+ * move is in progress this is the interpolated position, not the target.
+ *
+ * @param servo Servo to read.
+ */
+uint16_t servo_get_pos(uint8_t servo);
+
+/**
+ * Check if a servo is still moving towards its target.
+ *
+ * @param servo Servo to check.
+ * @return 1 if the servo is moving.
+ */
+uint8_t servo_is_moving(uint8_t servo);
+
+/**
+ * Wait until a servo reaches its target.
+ *
+ * @param servo Servo to wait for.
+ */
+void servo_wait(uint8_t servo);
+
+#endif
+
 #endif
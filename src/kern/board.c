@@ -35,6 +35,9 @@
 #include <hal/delay.h>
 #include <kern/global.h>
 #include <kern/lock.h>
+#include <kern/log.h>
+#include <kern/periodic.h>
+#include <sampler.h>
 #ifndef SIMULATE
 #include <kern/isr.h>
 #include <kern/memlayout.h>
@@ -170,6 +173,7 @@ void board_init (void) {
 	#endif
     encoder_init();
 	#ifndef SIMULATE
+    periodic_init();
     spi_init();
     motor_init();
     servo_init();
@@ -183,6 +187,10 @@ void board_init (void) {
     adc_init();
     isr_init();
     memory_init();
+    log_init();
+    sampler_init();
+    battery_init();
+    buttons_init();
 	#endif
 
     // load config, or fail if invalid
@@ -221,6 +229,10 @@ void board_init (void) {
 	#else
 	printf("Skipping FPGA initialization...\n");
 	#endif
+    encoder_probe();
+	#ifndef SIMULATE
+    digital_probe();
+	#endif
 
     // all ok
 #ifndef SIMULATE
@@ -33,6 +33,8 @@
 #include <kern/thread.h>
 #include <kern/global.h>
 #include <gyro.h>
+#include <sampler.h>
+#include <buttons.h>
 
 extern uint32_t global_time;
 
@@ -41,6 +43,9 @@ ISR(TIMER2_OVF_vect) {
 
     global_time++;
 
+    sampler_tick();
+    beeper_tick();
+
     yield();
 }
 
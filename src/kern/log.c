@@ -0,0 +1,229 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+// Deferred-formatting binary log
+//
+// Records are queued into a ring buffer by log_write_P() and sent out by
+// the UART data-register-empty interrupt. See tools/logdecode.py for the
+// host side.
+
+#ifndef SIMULATE
+
+#include <kern/global.h>
+#include <kern/log.h>
+#include <kern/lock.h>
+#include <kern/thread.h>
+#include <hal/io.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+// The ring buffer is indexed with uint8_t, so it must be exactly 256 bytes:
+// head and tail wrap by themselves and (head - tail) is always the fill level.
+#define LOG_RING_SIZE 256
+
+extern struct lock uart_lock;
+
+static uint8_t *log_buf = NULL;
+static volatile uint8_t log_head = 0;   // next position to write to
+static volatile uint8_t log_tail = 0;   // next position to send from
+static volatile uint8_t log_tx_remaining = 0; // bytes left of the record on the wire
+static volatile uint16_t log_dropped = 0;
+
+void log_init(void) {
+    log_buf = malloc(LOG_RING_SIZE);
+    if (!log_buf)
+        panic("log_init");
+    log_head = 0;
+    log_tail = 0;
+}
+
+// append n bytes at args+len, returns the new length, or 0xFF if full
+static uint8_t log_put(uint8_t *args, uint8_t len, const void *data, uint8_t n) {
+    if (len == 0xFF || len + n > LOG_ARGS_MAX)
+        return 0xFF;
+    const uint8_t *src = data;
+    while (n--)
+        args[len++] = *src++;
+    return len;
+}
+
+void log_write_P(uint8_t level, PGM_P fmt, ...) {
+    uint8_t rec[LOG_HDR_SIZE + LOG_ARGS_MAX];
+    uint8_t *args = rec + LOG_HDR_SIZE;
+    uint8_t len = 0;
+    PGM_P p = fmt;
+    char c;
+    va_list ap;
+
+    // walk the format string and copy out the raw argument values; this
+    // mirrors what vfprintf would fetch with va_arg, without formatting
+    va_start(ap, fmt);
+    while ((c = pgm_read_byte(p++)) != '\0') {
+        if (c != '%')
+            continue;
+
+        uint8_t is_long = 0;
+        for (;;) {
+            c = pgm_read_byte(p++);
+            if (c == 'l') {
+                is_long = 1;
+            } else if (c == '*') {
+                int w = va_arg(ap, int);
+                len = log_put(args, len, &w, sizeof(w));
+            } else if (!((c >= '0' && c <= '9') || c == '.' || c == '-' ||
+                        c == '+' || c == ' ' || c == '#' || c == 'h')) {
+                break;
+            }
+        }
+
+        switch (c) {
+            case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+                if (is_long) {
+                    long v = va_arg(ap, long);
+                    len = log_put(args, len, &v, sizeof(v));
+                } else {
+                    int v = va_arg(ap, int);
+                    len = log_put(args, len, &v, sizeof(v));
+                }
+                break;
+            case 'c': {
+                int v = va_arg(ap, int);
+                len = log_put(args, len, &v, sizeof(v));
+                break;
+            }
+            case 'p': case 'S': {
+                // program memory strings are looked up by the decoder
+                const void *v = va_arg(ap, const void *);
+                len = log_put(args, len, &v, sizeof(v));
+                break;
+            }
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': {
+                double v = va_arg(ap, double);
+                len = log_put(args, len, &v, sizeof(v));
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(ap, const char *);
+                uint8_t n = 0;
+                while (s && n < LOG_STR_MAX && s[n])
+                    n++;
+                len = log_put(args, len, &n, 1);
+                len = log_put(args, len, s, n);
+                break;
+            }
+            case '\0':
+                p--;
+                break;
+            default:
+                break;
+        }
+    }
+    va_end(ap);
+
+    // out of room for arguments; the decoder prints '?' for the rest
+    if (len == 0xFF)
+        len = LOG_ARGS_MAX;
+
+    uint16_t id = (uint16_t)fmt;
+    uint32_t time = get_time();
+    rec[0] = LOG_SYNC;
+    rec[1] = level;
+    rec[2] = len;
+    rec[3] = id & 0xFF;
+    rec[4] = id >> 8;
+    rec[5] = time & 0xFF;
+    rec[6] = (time >> 8) & 0xFF;
+    rec[7] = (time >> 16) & 0xFF;
+    rec[8] = time >> 24;
+
+    uint8_t total = LOG_HDR_SIZE + len;
+
+    ATOMIC_BEGIN;
+    if (!log_buf || (uint8_t)(LOG_RING_SIZE - 1 - (uint8_t)(log_head - log_tail)) < total) {
+        log_dropped++;
+    } else {
+        uint8_t head = log_head;
+        for (uint8_t i = 0; i < total; i++)
+            log_buf[head++] = rec[i];
+        log_head = head;
+    }
+    ATOMIC_END;
+
+    log_kick();
+}
+
+uint16_t log_get_dropped(void) {
+    ATOMIC_BEGIN;
+    uint16_t n = log_dropped;
+    ATOMIC_END;
+    return n;
+}
+
+void log_kick(void) {
+    ATOMIC_BEGIN;
+    // never start a record in the middle of someone's printf
+    if (log_buf && log_head != log_tail && !uart_lock.locked)
+        UCSR0B |= _BV(UDRIE0);
+    ATOMIC_END;
+}
+
+void log_uart_claim(void) {
+    if (!(SREG & SREG_IF)) {
+        // the interrupt can't finish the record for us (e.g. panic), so
+        // abandon the rest of it
+        UCSR0B &= ~_BV(UDRIE0);
+        log_tail += log_tx_remaining;
+        log_tx_remaining = 0;
+        return;
+    }
+
+    for (;;) {
+        ATOMIC_BEGIN;
+        if (!log_tx_remaining) {
+            // stop the drain until the caller is done with the UART
+            UCSR0B &= ~_BV(UDRIE0);
+            ATOMIC_END;
+            return;
+        }
+        ATOMIC_END;
+    }
+}
+
+ISR(USART0_UDRE_vect) {
+    if (!log_tx_remaining) {
+        // at a record boundary: stop if there is nothing to send, or if a
+        // thread is printing text
+        if (log_head == log_tail || uart_lock.locked) {
+            UCSR0B &= ~_BV(UDRIE0);
+            return;
+        }
+        log_tx_remaining = LOG_HDR_SIZE + log_buf[(uint8_t)(log_tail + 2)];
+    }
+
+    UDR0 = log_buf[log_tail++];
+    log_tx_remaining--;
+}
+
+#endif
@@ -35,6 +35,7 @@
 #include <buttons.h>
 #include <kern/global.h>
 #include <kern/memlayout.h>
+#include <kern/periodic.h>
 #include <kern/thread.h>
 #include <kern/thread.h>
 #include <kern/util.h>
@@ -70,8 +71,19 @@ int robot_monitor (void) {
     printf("Finished usetup().\n");
 
     printf("Waiting for RF start, or press Go to start now.\n");
+	#ifndef SIMULATE
+    // only count presses made from now on, not leftovers from usetup()
+    button_flush_events();
+    // check rf_start now and then while waiting for Go
+    while (!rf_start) {
+        uint8_t e = button_get_event(50);
+        if (e == BUTTON_EVENT(BUTTON_GO, BUTTON_PRESS))
+            break;
+    }
+	#else
     while (!rf_start && !go_press())
       yield();
+	#endif
 
     printf("Running umain()...\n");
     return umain();
@@ -89,6 +101,7 @@ int main (void) {
 	#ifndef SIMULATE
     init_thread();
     create_thread(&robot_monitor, STACK_DEFAULT, 0, "main");
+    periodic_start();
     rf_init();
     schedule();
 	#else 
@@ -0,0 +1,103 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+// Periodic task service
+
+#ifndef SIMULATE
+
+#include <kern/global.h>
+#include <kern/periodic.h>
+#include <kern/lock.h>
+#include <kern/thread.h>
+
+static struct lock periodic_lock;
+static struct periodic_task *periodic_tasks = NULL;
+
+void periodic_init(void) {
+    init_lock(&periodic_lock, "periodic lock");
+    periodic_tasks = NULL;
+}
+
+void periodic_add(struct periodic_task *task, void (*fn)(void *), void *arg,
+        uint16_t period) {
+    acquire(&periodic_lock);
+    task->fn = fn;
+    task->arg = arg;
+    task->period = period;
+    task->due = get_time();
+    task->next = periodic_tasks;
+    periodic_tasks = task;
+    release(&periodic_lock);
+}
+
+void periodic_remove(struct periodic_task *task) {
+    acquire(&periodic_lock);
+    for (struct periodic_task **p = &periodic_tasks; *p; p = &(*p)->next) {
+        if (*p == task) {
+            *p = task->next;
+            break;
+        }
+    }
+    release(&periodic_lock);
+}
+
+static int periodic_loop(void) {
+    for (;;) {
+        uint32_t now = get_time();
+        uint32_t wake = now + PERIODIC_MAX_SLEEP;
+
+        acquire(&periodic_lock);
+        struct periodic_task *t = periodic_tasks;
+        while (t) {
+            // the task may remove itself
+            struct periodic_task *next = t->next;
+            if ((int32_t)(now - t->due) >= 0) {
+                t->fn(t->arg);
+                t->due += t->period;
+                // fell behind: skip the missed runs
+                if ((int32_t)(now - t->due) >= 0)
+                    t->due = now + t->period;
+            }
+            if ((int32_t)(t->due - wake) < 0)
+                wake = t->due;
+            t = next;
+        }
+        release(&periodic_lock);
+
+        now = get_time();
+        if ((int32_t)(wake - now) > 0)
+            pause(wake - now);
+        else
+            yield();
+    }
+
+    return 0;
+}
+
+void periodic_start(void) {
+    create_thread(&periodic_loop, STACK_DEFAULT, 0, "periodic");
+}
+
+#endif
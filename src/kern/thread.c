@@ -41,6 +41,8 @@
 #include <string.h>
 #include <avr/interrupt.h>
 #include <kern/lock.h>
+#include <kern/log.h>
+#include <fpga.h>
 
 #else
 
@@ -78,8 +80,8 @@ void init_thread(void) {
     //if ((STACKTOP(MAX_THREADS) < __bss_end))
     //  panic("no space for stacks");
 
-    printf ("thread table start at %p\n", &threads);
-    printf ("thread table end at %p\n", &threads[MAX_THREADS]);
+    log_debug("thread table start at %p", &threads);
+    log_debug("thread table end at %p", &threads[MAX_THREADS]);
 
     // set all threads as free
     int i;
@@ -88,7 +90,7 @@ void init_thread(void) {
         threads[i].th_status = THREAD_FREE;
         threads[i].th_stacktop = STACKTOP(i);
         threads[i].th_runs = 0;
-        printf("(id %d) stack [%p,%p)\n",
+        log_debug("(id %d) stack [%p,%p)",
                 i, STACKTOP(i), STACKTOP(i+1));
     }
 
@@ -212,8 +214,14 @@ long get_time_us (void) {
     ATOMIC_BEGIN;
 
     long current_time;
+    uint8_t tcnt = TCNT2;
+    uint8_t ticks = tcnt - TIMER_1MS_EXPIRE;
+    // the timer may have wrapped with its interrupt still pending (when
+    // called from another interrupt handler)
+    if ((TIFR & _BV(TOV2)) && tcnt < TIMER_1MS_EXPIRE)
+        ticks = tcnt + (256 - TIMER_1MS_EXPIRE);
     current_time = global_time * 1000 +
-        (uint32_t) (TCNT2 - TIMER_1MS_EXPIRE) * US_PER_TICK;
+        (uint32_t) ticks * US_PER_TICK;
 
     ATOMIC_END;
 
@@ -329,6 +337,52 @@ void yield(void) {
 
 }
 
+#ifndef SIMULATE
+
+void thread_sleep(void *chan) {
+    if (!current_thread)
+        panic("sleep in kernel");
+
+    current_thread->th_channel = chan;
+    current_thread->th_status = THREAD_SLEEPING;
+
+    yield();
+}
+
+uint8_t thread_sleep_timeout(void *chan, uint32_t ms) {
+    if (!current_thread)
+        panic("sleep in kernel");
+
+    // a paused thread with a channel can be woken either way; the channel is
+    // cleared by thread_wakeup() only
+    current_thread->th_channel = chan;
+    current_thread->th_wakeup_time = global_time + ms;
+    current_thread->th_status = THREAD_PAUSED;
+
+    yield();
+
+    uint8_t woken = (current_thread->th_channel == NULL);
+    current_thread->th_channel = NULL;
+    return woken;
+}
+
+void thread_wakeup(void *chan) {
+    ATOMIC_BEGIN;
+
+    for (uint8_t i = 0; i < MAX_THREADS; i++) {
+        if ((threads[i].th_status == THREAD_SLEEPING ||
+                    threads[i].th_status == THREAD_PAUSED) &&
+                threads[i].th_channel == chan) {
+            threads[i].th_channel = NULL;
+            threads[i].th_status = THREAD_RUNNABLE;
+        }
+    }
+
+    ATOMIC_END;
+}
+
+#endif
+
 void thread_exit(int status) {
 
 	#ifndef SIMULATE
@@ -417,6 +471,7 @@ uint8_t create_thread(int (*func)(), uint16_t stacksize, uint8_t priority, char
     threads[i].th_status = THREAD_RUNNABLE;
     threads[i].th_name = name;
     threads[i].th_runs = 0;
+    threads[i].th_channel = NULL;
     threads[i].th_stacksize = STACKSIZE;
     threads[i].th_func = func;
 
@@ -453,6 +508,10 @@ void halt(void) {
     extern struct lock servo_lock;
     smash(&servo_lock);
 
+    // a thread stopped inside motor_set_vels() may have left the motor
+    // registers held, which would hide the brake writes below
+    fpga_write_byte(FPGA_MOTOR_HOLD, 0);
+
 	#endif
 
     // brake each motor
@@ -35,7 +35,8 @@ uint16_t irdist_read(int port) {
 
 	#ifndef SIMULATE
 
-    uint16_t v = analog_read(port);
+    // filters attached to the port (e.g. a median) apply here
+    uint16_t v = analog_read_filtered(port);
     return irdist_cal_m/v - irdist_cal_c;
 
 	#else
@@ -9,10 +9,10 @@ MotorGroup motor_group_new(bool m0, bool m1, bool m2, bool m3, bool m4, bool m5)
 }
 
 void motor_group_set_vel(MotorGroup group, int16_t vel) {
-    for (uint8_t i=0; i<6; i++) {
-        if (motor_group_has(group, i))
-            motor_set_vel(i, vel);
-    }
+    int16_t vels[6];
+    for (uint8_t i=0; i<6; i++)
+        vels[i] = vel;
+    motor_set_vels(group, vels);
 }
 
 void motor_group_brake(MotorGroup group) {
@@ -0,0 +1,141 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SIMULATE
+
+#include <lib/motor_speed.h>
+#include <lib/pid.h>
+#include <kern/lock.h>
+#include <kern/periodic.h>
+#include <encoder.h>
+#include <motor.h>
+
+struct motor_speed {
+    struct pid_controller pid;
+    float kf;
+    int32_t measured;
+    int16_t drive;          // last output
+    uint8_t encoder;
+    uint8_t enabled;
+};
+
+static struct motor_speed speeds[6];
+static struct lock speed_lock;
+static struct periodic_task speed_task;
+static uint8_t speed_started = 0;
+
+// limit a value
+#define limit(v, min, max) (((v)>(max)) ? (max) : ((v)<(min)) ? (min) : (v))
+
+static void motor_speed_update(void *arg) {
+    acquire(&speed_lock);
+    for (uint8_t i = 0; i < 6; i++) {
+        struct motor_speed *s = &speeds[i];
+        if (!s->enabled)
+            continue;
+
+        s->measured = encoder_get_velocity(s->encoder) / 1000;
+        // a counting encoder can't tell direction, so assume the motor turns
+        // the way it was last driven
+        if (s->drive < 0 && !encoder_is_quadrature(s->encoder))
+            s->measured = -s->measured;
+
+        if (s->pid.goal == 0) {
+            // coast, and start the next run from a clean integrator
+            s->pid.has_past = 0;
+            s->pid.sum = 0;
+            s->drive = 0;
+            motor_set_vel(i, 0);
+            continue;
+        }
+
+        float drive = s->kf * s->pid.goal + update_pid_input(&s->pid, s->measured);
+
+        // stop the integrator winding up while the output is saturated
+        if ((drive > 255 || drive < -255) && s->pid.ki != 0) {
+            float max_sum = (255 - s->kf * s->pid.goal) / s->pid.ki;
+            float min_sum = (-255 - s->kf * s->pid.goal) / s->pid.ki;
+            if (max_sum < min_sum) {
+                float t = max_sum;
+                max_sum = min_sum;
+                min_sum = t;
+            }
+            s->pid.sum = limit(s->pid.sum, min_sum, max_sum);
+        }
+
+        s->drive = (int16_t) (limit(drive, -255, 255));
+        motor_set_vel(i, s->drive);
+    }
+    release(&speed_lock);
+}
+
+void motor_speed_init(uint8_t motor, uint8_t encoder,
+        float kf, float kp, float ki, float kd) {
+    if (!speed_started) {
+        init_lock(&speed_lock, "speed lock");
+        periodic_add(&speed_task, motor_speed_update, NULL, MOTOR_SPEED_PERIOD);
+        speed_started = 1;
+    }
+
+    acquire(&speed_lock);
+    struct motor_speed *s = &speeds[motor];
+    init_pid(&s->pid, kp, ki, kd, NULL, NULL);
+    s->pid.goal = 0;
+    s->pid.enabled = true;
+    s->kf = kf;
+    s->measured = 0;
+    s->drive = 0;
+    s->encoder = encoder;
+    s->enabled = 1;
+    release(&speed_lock);
+}
+
+void motor_set_speed(uint8_t motor, int32_t speed) {
+    if (!speed_started)
+        return;
+    acquire(&speed_lock);
+    speeds[motor].pid.goal = speed;
+    release(&speed_lock);
+}
+
+int32_t motor_get_speed(uint8_t motor) {
+    if (!speed_started)
+        return 0;
+    acquire(&speed_lock);
+    int32_t speed = speeds[motor].measured;
+    release(&speed_lock);
+    return speed;
+}
+
+void motor_speed_disable(uint8_t motor) {
+    if (!speed_started)
+        return;
+    acquire(&speed_lock);
+    speeds[motor].enabled = 0;
+    motor_set_vel(motor, 0);
+    release(&speed_lock);
+}
+
+#endif
@@ -0,0 +1,219 @@
+/*
+ * The MIT License
+ *
+ * Copyright (c) 2007 MIT 6.270 Robotics Competition
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef SIMULATE
+
+#include <lib/pose.h>
+#include <kern/lock.h>
+#include <kern/periodic.h>
+#include <kern/thread.h>
+#include <encoder.h>
+#include <gyro.h>
+#include <rf.h>
+#include <math.h>
+
+#define DEG_TO_RAD (M_PI / 180.0)
+
+// odometry: position integrated in the gyro's frame
+struct pose_sample {
+    uint32_t time;      // ms
+    float x;
+    float y;
+    float heading;      // gyro degrees
+};
+
+static struct lock pose_lock;
+static struct periodic_task pose_task;
+static uint8_t pose_started = 0;
+
+static uint8_t left_encoder, right_encoder;
+static float left_scale, right_scale;
+static int32_t left_last, right_last;
+
+static struct pose_sample odom;
+static struct pose_sample history[POSE_HISTORY];
+static uint8_t history_next = 0;
+static uint8_t history_count = 0;
+
+static uint16_t vps_latency = POSE_VPS_LATENCY_DEFAULT;
+static uint8_t fix_valid = 0;
+static uint8_t fix_seq = 0;
+static struct pose fix;             // the last VPS fix
+static struct pose_sample fix_odom; // odometry at the time of the fix
+
+// difference between two headings, in (-180, 180]
+static float heading_diff(float a, float b) {
+    float d = fmod(a - b, 360.0);
+    if (d > 180)
+        d -= 360;
+    else if (d <= -180)
+        d += 360;
+    return d;
+}
+
+// odometry at time t, from the history
+static struct pose_sample *pose_lookup(uint32_t t) {
+    struct pose_sample *best = &odom;
+    for (uint8_t i = 1; i <= history_count; i++) {
+        struct pose_sample *s =
+            &history[(uint8_t)(history_next + POSE_HISTORY - i) % POSE_HISTORY];
+        best = s;
+        if ((int32_t)(t - s->time) >= 0)
+            break;
+    }
+    // older than the history: use the oldest sample
+    return best;
+}
+
+static int32_t pose_read_encoder(uint8_t encoder, int32_t *last) {
+    int32_t count = encoder_read32(encoder);
+    int32_t delta = count - *last;
+    *last = count;
+    return delta;
+}
+
+static void pose_update(void *arg) {
+    float heading = gyro_get_degrees();
+    float dist = 0;
+    uint8_t n = 0;
+
+    acquire(&pose_lock);
+
+    if (left_encoder != POSE_NO_ENCODER) {
+        dist += pose_read_encoder(left_encoder, &left_last) * left_scale;
+        n++;
+    }
+    if (right_encoder != POSE_NO_ENCODER) {
+        dist += pose_read_encoder(right_encoder, &right_last) * right_scale;
+        n++;
+    }
+    if (n)
+        dist /= n;
+
+    // integrate along the mean heading over the period
+    float mid = (odom.heading + heading_diff(heading, odom.heading) / 2) * DEG_TO_RAD;
+    odom.x += dist * cos(mid);
+    odom.y += dist * sin(mid);
+    odom.heading = heading;
+    odom.time = get_time();
+
+    history[history_next] = odom;
+    history_next = (history_next + 1) % POSE_HISTORY;
+    if (history_count < POSE_HISTORY)
+        history_count++;
+
+    // take a new VPS fix
+    board_coord coord;
+    uint32_t time_ms;
+    uint8_t seq = game_read_fix(&coord, &time_ms);
+    if (seq && seq != fix_seq) {
+        fix_seq = seq;
+        fix.x = coord.x;
+        fix.y = coord.y;
+        fix.theta = ((float) coord.theta) * 360.0 / 4096.0;
+        fix_odom = *pose_lookup(time_ms - vps_latency);
+        fix_valid = 1;
+    }
+
+    release(&pose_lock);
+}
+
+int8_t pose_init(uint8_t left, uint8_t right, float lscale, float rscale) {
+    // only quadrature counts carry the direction of travel
+    if (left == right && left != POSE_NO_ENCODER)
+        return -1;
+    if ((left != POSE_NO_ENCODER && left != 24 && left != 26) ||
+            (right != POSE_NO_ENCODER && right != 24 && right != 26))
+        return -1;
+    if (left != POSE_NO_ENCODER && encoder_set_quadrature(left, 1) < 0)
+        return -1;
+    if (right != POSE_NO_ENCODER && encoder_set_quadrature(right, 1) < 0)
+        return -1;
+
+    if (!pose_started)
+        init_lock(&pose_lock, "pose lock");
+
+    acquire(&pose_lock);
+    left_encoder = left;
+    right_encoder = right;
+    left_scale = lscale;
+    right_scale = rscale;
+    if (left != POSE_NO_ENCODER)
+        left_last = encoder_read32(left);
+    if (right != POSE_NO_ENCODER)
+        right_last = encoder_read32(right);
+
+    odom.x = 0;
+    odom.y = 0;
+    odom.heading = gyro_get_degrees();
+    odom.time = get_time();
+    history_count = 0;
+    history_next = 0;
+    // the odometry frame has moved, so wait for the next fix
+    fix_valid = 0;
+    release(&pose_lock);
+
+    if (!pose_started) {
+        periodic_add(&pose_task, pose_update, NULL, POSE_PERIOD);
+        pose_started = 1;
+    }
+    return 0;
+}
+
+void pose_set_vps_latency(uint16_t ms) {
+    if (!pose_started)
+        return;
+    acquire(&pose_lock);
+    vps_latency = ms;
+    release(&pose_lock);
+}
+
+uint8_t get_predicted_pose(struct pose *p) {
+    if (!pose_started || !fix_valid)
+        return 0;
+
+    float heading = gyro_get_degrees();
+
+    acquire(&pose_lock);
+    // rotation from the gyro's frame to the VPS frame
+    float rot = heading_diff(fix.theta, fix_odom.heading) * DEG_TO_RAD;
+    float dx = odom.x - fix_odom.x;
+    float dy = odom.y - fix_odom.y;
+    float c = cos(rot);
+    float s = sin(rot);
+
+    p->x = fix.x + dx * c - dy * s;
+    p->y = fix.y + dx * s + dy * c;
+    p->theta = fix.theta + heading_diff(heading, fix_odom.heading);
+    release(&pose_lock);
+
+    if (p->theta < 0)
+        p->theta += 360;
+    else if (p->theta >= 360)
+        p->theta -= 360;
+    return 1;
+}
+
+#endif
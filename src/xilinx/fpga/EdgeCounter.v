@@ -0,0 +1,24 @@
+// Counts falling edges of a digital input (a switch closing), after the
+// input has been stable for about 2ms.
+module EdgeCounter(clk, in, count);
+	input clk;
+	input in;
+	output reg [15:0] count = 0;
+	reg [1:0] sync;
+	reg state = 1;
+	reg [13:0] stable;
+
+	always @ (posedge clk) begin
+		sync <= {sync[0], in};
+		if (sync[1] == state) begin
+			stable <= 0;
+		end else if (stable == 14'h3FFF) begin
+			state <= sync[1];
+			stable <= 0;
+			if (!sync[1])
+				count <= count + 1;
+		end else begin
+			stable <= stable + 1;
+		end
+	end
+endmodule
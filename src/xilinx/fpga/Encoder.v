@@ -3,8 +3,8 @@ module Encoder(clk, enc, count);
 	input enc;
 	reg enc_clean, enc_new;
 	reg [7:0] debounce;
-	output [15:0] count;
-	reg [15:0] count;
+	output [31:0] count;
+	reg [31:0] count;
 
 	always @ (posedge clk)
      if (enc != enc_new) begin enc_new <= enc; debounce <= 0; end
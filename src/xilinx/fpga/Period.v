@@ -0,0 +1,21 @@
+// Measures the time between changes of an encoder count, in units of tick.
+// period is the time between the last two changes, age the time since the
+// last one. Both saturate at 16'hFFFF.
+module Period(clk, tick, step, period, age);
+	input clk;
+	input tick;
+	input step;
+	output reg [15:0] period = 16'hFFFF;
+	output reg [15:0] age = 16'hFFFF;
+	reg [1:0] sync;
+
+	always @ (posedge clk) begin
+		sync <= {sync[0], step};
+		if (sync[1] != sync[0]) begin
+			period <= age;
+			age <= 0;
+		end else if (tick && age != 16'hFFFF) begin
+			age <= age + 1;
+		end
+	end
+endmodule
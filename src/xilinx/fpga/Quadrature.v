@@ -2,9 +2,9 @@ module Quadrature(clk, enc_a, enc_b, count);
     input clk;
     input enc_a;
     input enc_b;
-    output count;
+    output [31:0] count;
     
-    reg signed [15:0] count;
+    reg signed [31:0] count;
 
     wire [1:0] cur_state;
     reg [1:0] last_state;
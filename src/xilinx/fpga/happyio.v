@@ -3,6 +3,8 @@
 `include "Encoder.v"
 `include "Debouncer.v"
 `include "Quadrature.v"
+`include "Period.v"
+`include "EdgeCounter.v"
 `include "Pwm.v"
 
 module happyio(clk, ad, a, aout, ale, nRD, nWR, mot0, mot1, mot2, mot3, mot4, mot5, Servo, Enc, Digital, ramce);
@@ -63,12 +65,68 @@ module happyio(clk, ad, a, aout, ale, nRD, nWR, mot0, mot1, mot2, mot3, mot4, mo
 	reg [7:0] mc1_vel;
 	reg [1:0] mc2_ctl;
 	reg [7:0] mc2_vel;
+	// motor values driving the outputs; while motorHold is set they keep
+	// their old values, so a group of writes takes effect on one clock
+	reg motorHold = 0;
+	reg [1:0] ma1_ctl_live;
+	reg [7:0] ma1_vel_live;
+	reg [1:0] ma2_ctl_live;
+	reg [7:0] ma2_vel_live;
+	reg [1:0] mb1_ctl_live;
+	reg [7:0] mb1_vel_live;
+	reg [1:0] mb2_ctl_live;
+	reg [7:0] mb2_vel_live;
+	reg [1:0] mc1_ctl_live;
+	reg [7:0] mc1_vel_live;
+	reg [1:0] mc2_ctl_live;
+	reg [7:0] mc2_vel_live;
 	
 	// registers (encoders)
-	wire [15:0] enc0;
-	wire [15:0] enc1;
-	wire [15:0] enc2;
-	wire [15:0] enc3;
+	wire [31:0] enc0;
+	wire [31:0] enc1;
+	wire [31:0] enc2;
+	wire [31:0] enc3;
+	wire [31:0] cnt0;
+	wire [31:0] cnt1;
+	wire [31:0] cnt2;
+	wire [31:0] cnt3;
+	wire [31:0] quad0;
+	wire [31:0] quad1;
+	// bit 0: quadrature on Enc[1:0] as encoder 0
+	// bit 1: quadrature on Enc[3:2] as encoder 2
+	reg [1:0] encMode = 2'b00;
+	// upper 24 bits of a 32-bit encoder read, latched by reading byte 0
+	reg [23:0] encLatch;
+	// encoder edge timing, in 16us units
+	wire [15:0] per0;
+	wire [15:0] per1;
+	wire [15:0] per2;
+	wire [15:0] per3;
+	wire [15:0] age0;
+	wire [15:0] age1;
+	wire [15:0] age2;
+	wire [15:0] age3;
+	reg [6:0] perDiv = 0;
+	wire perTick = (perDiv == 0);
+	// free-running microsecond counter
+	reg [2:0] usDiv = 0;
+	reg [31:0] usTime = 0;
+	// all-encoder snapshot, taken by writing 0x1160
+	reg [31:0] snapTime;
+	reg [31:0] snap0;
+	reg [31:0] snap1;
+	reg [31:0] snap2;
+	reg [31:0] snap3;
+
+	// digital input edge counters
+	wire [15:0] edge0;
+	wire [15:0] edge1;
+	wire [15:0] edge2;
+	wire [15:0] edge3;
+	wire [15:0] edge4;
+	wire [15:0] edge5;
+	wire [15:0] edge6;
+	wire [15:0] edge7;
 	
 	// registers (servos)
 	reg [9:0] srv0;
@@ -124,13 +182,13 @@ module happyio(clk, ad, a, aout, ale, nRD, nWR, mot0, mot1, mot2, mot3, mot4, mo
 			16'h110A:	dataOut[1:0] = mc2_ctl;
 			16'h110B:	dataOut = mc2_vel;
 			// 0x110C - 0x1113 : encoders
-			16'h110C:	{tempHi, dataOut} = enc0;
+			16'h110C:	{tempHi, dataOut} = enc0[15:0];
 			16'h110D:	dataOut = tempHi;
-			16'h110E:	{tempHi, dataOut} = enc1;
+			16'h110E:	{tempHi, dataOut} = enc1[15:0];
 			16'h110F:	dataOut = tempHi;
-			16'h1110:	{tempHi, dataOut} = enc2;
+			16'h1110:	{tempHi, dataOut} = enc2[15:0];
 			16'h1111:	dataOut = tempHi;
-			16'h1112:	{tempHi, dataOut} = enc3;
+			16'h1112:	{tempHi, dataOut} = enc3[15:0];
 			16'h1113:	dataOut = tempHi;
 			// 0x1120 - 0x112B : servos
 			/*
@@ -143,10 +201,86 @@ module happyio(clk, ad, a, aout, ale, nRD, nWR, mot0, mot1, mot2, mot3, mot4, mo
 			*/
 			// 0x11 : digital in
 			16'h111E:	dataOut = Digital;
+			// 0x113A : encoder mode
+			16'h113A:	dataOut[1:0] = encMode;
+			// 0x113B : motor hold
+			16'h113B:	dataOut[0] = motorHold;
+			// 0x1140 - 0x114F : 32-bit encoders
+			16'h1140:	{encLatch, dataOut} = enc0;
+			16'h1141:	dataOut = encLatch[7:0];
+			16'h1142:	dataOut = encLatch[15:8];
+			16'h1143:	dataOut = encLatch[23:16];
+			16'h1144:	{encLatch, dataOut} = enc1;
+			16'h1145:	dataOut = encLatch[7:0];
+			16'h1146:	dataOut = encLatch[15:8];
+			16'h1147:	dataOut = encLatch[23:16];
+			16'h1148:	{encLatch, dataOut} = enc2;
+			16'h1149:	dataOut = encLatch[7:0];
+			16'h114A:	dataOut = encLatch[15:8];
+			16'h114B:	dataOut = encLatch[23:16];
+			16'h114C:	{encLatch, dataOut} = enc3;
+			16'h114D:	dataOut = encLatch[7:0];
+			16'h114E:	dataOut = encLatch[15:8];
+			16'h114F:	dataOut = encLatch[23:16];
+			// 0x1150 - 0x115F : encoder period and age
+			16'h1150:	{encLatch, dataOut} = {age0, per0};
+			16'h1151:	dataOut = encLatch[7:0];
+			16'h1152:	dataOut = encLatch[15:8];
+			16'h1153:	dataOut = encLatch[23:16];
+			16'h1154:	{encLatch, dataOut} = {age1, per1};
+			16'h1155:	dataOut = encLatch[7:0];
+			16'h1156:	dataOut = encLatch[15:8];
+			16'h1157:	dataOut = encLatch[23:16];
+			16'h1158:	{encLatch, dataOut} = {age2, per2};
+			16'h1159:	dataOut = encLatch[7:0];
+			16'h115A:	dataOut = encLatch[15:8];
+			16'h115B:	dataOut = encLatch[23:16];
+			16'h115C:	{encLatch, dataOut} = {age3, per3};
+			16'h115D:	dataOut = encLatch[7:0];
+			16'h115E:	dataOut = encLatch[15:8];
+			16'h115F:	dataOut = encLatch[23:16];
+			// 0x1160 - 0x1173 : encoder snapshot
+			16'h1160:	dataOut = snapTime[7:0];
+			16'h1161:	dataOut = snapTime[15:8];
+			16'h1162:	dataOut = snapTime[23:16];
+			16'h1163:	dataOut = snapTime[31:24];
+			16'h1164:	dataOut = snap0[7:0];
+			16'h1165:	dataOut = snap0[15:8];
+			16'h1166:	dataOut = snap0[23:16];
+			16'h1167:	dataOut = snap0[31:24];
+			16'h1168:	dataOut = snap1[7:0];
+			16'h1169:	dataOut = snap1[15:8];
+			16'h116A:	dataOut = snap1[23:16];
+			16'h116B:	dataOut = snap1[31:24];
+			16'h116C:	dataOut = snap2[7:0];
+			16'h116D:	dataOut = snap2[15:8];
+			16'h116E:	dataOut = snap2[23:16];
+			16'h116F:	dataOut = snap2[31:24];
+			16'h1170:	dataOut = snap3[7:0];
+			16'h1171:	dataOut = snap3[15:8];
+			16'h1172:	dataOut = snap3[23:16];
+			16'h1173:	dataOut = snap3[31:24];
+			// 0x1180 - 0x118F : digital edge counters
+			16'h1180:	{tempHi, dataOut} = edge0;
+			16'h1181:	dataOut = tempHi;
+			16'h1182:	{tempHi, dataOut} = edge1;
+			16'h1183:	dataOut = tempHi;
+			16'h1184:	{tempHi, dataOut} = edge2;
+			16'h1185:	dataOut = tempHi;
+			16'h1186:	{tempHi, dataOut} = edge3;
+			16'h1187:	dataOut = tempHi;
+			16'h1188:	{tempHi, dataOut} = edge4;
+			16'h1189:	dataOut = tempHi;
+			16'h118A:	{tempHi, dataOut} = edge5;
+			16'h118B:	dataOut = tempHi;
+			16'h118C:	{tempHi, dataOut} = edge6;
+			16'h118D:	dataOut = tempHi;
+			16'h118E:	{tempHi, dataOut} = edge7;
+			16'h118F:	dataOut = tempHi;
 			// 0x11FE : major version
 			16'h11FE:	dataOut = 0;
 			// 0x11FF : minor version
-			16'h11FF:	dataOut = 7;
+			16'h11FF:	dataOut = 12;
 		endcase
 	end
 	
@@ -215,29 +349,78 @@ module happyio(clk, ad, a, aout, ale, nRD, nWR, mot0, mot1, mot2, mot3, mot4, mo
 			16'h1136:	digitalPwm[5] = data;
 			16'h1137:	digitalPwm[6] = data;
 			16'h1138:	digitalPwm[7] = data;
+
+			// Encoder mode
+			16'h113A:	encMode = data[1:0];
+
+			// Motor hold
+			16'h113B:	motorHold = data[0];
+
+			// Encoder snapshot
+			16'h1160:	begin
+							snapTime = usTime;
+							snap0 = enc0;
+							snap1 = enc1;
+							snap2 = enc2;
+							snap3 = enc3;
+						end
 			// ...
 		endcase
 	end
 	
 
+	// motor commit
+	always @ (posedge clk)
+		if (!motorHold) begin
+			ma1_ctl_live <= ma1_ctl;
+			ma1_vel_live <= ma1_vel;
+			ma2_ctl_live <= ma2_ctl;
+			ma2_vel_live <= ma2_vel;
+			mb1_ctl_live <= mb1_ctl;
+			mb1_vel_live <= mb1_vel;
+			mb2_ctl_live <= mb2_ctl;
+			mb2_vel_live <= mb2_vel;
+			mc1_ctl_live <= mc1_ctl;
+			mc1_vel_live <= mc1_vel;
+			mc2_ctl_live <= mc2_ctl;
+			mc2_vel_live <= mc2_vel;
+		end
+
 	// motor drivers
-	Motor motor0(clk,mot0,ma2_ctl,ma2_vel);
-	Motor motor1(clk,mot1,ma1_ctl,ma1_vel);
-	Motor motor2(clk,mot2,mb2_ctl,mb2_vel);
-	Motor motor3(clk,mot3,mb1_ctl,mb1_vel);
-	Motor motor4(clk,mot4,mc2_ctl,mc2_vel);
-	Motor motor5(clk,mot5,mc1_ctl,mc1_vel);
+	Motor motor0(clk,mot0,ma2_ctl_live,ma2_vel_live);
+	Motor motor1(clk,mot1,ma1_ctl_live,ma1_vel_live);
+	Motor motor2(clk,mot2,mb2_ctl_live,mb2_vel_live);
+	Motor motor3(clk,mot3,mb1_ctl_live,mb1_vel_live);
+	Motor motor4(clk,mot4,mc2_ctl_live,mc2_vel_live);
+	Motor motor5(clk,mot5,mc1_ctl_live,mc1_vel_live);
 
 	// encoder drivers
-    `ifndef QUADRATURE
-	Encoder encoder0(clk,Enc[0],enc0);
-	Encoder encoder1(clk,Enc[1],enc1);
-	Encoder encoder2(clk,Enc[2],enc2);
-	Encoder encoder3(clk,Enc[3],enc3);
-    `else
-	Quadrature quad0(clk,Enc[0],Enc[1], enc0);
-	Quadrature quad1(clk,Enc[2],Enc[3], enc1);
-    `endif
+	Encoder encoder0(clk,Enc[0],cnt0);
+	Encoder encoder1(clk,Enc[1],cnt1);
+	Encoder encoder2(clk,Enc[2],cnt2);
+	Encoder encoder3(clk,Enc[3],cnt3);
+	Quadrature quadrature0(clk,Enc[0],Enc[1],quad0);
+	Quadrature quadrature1(clk,Enc[2],Enc[3],quad1);
+
+	assign enc0 = encMode[0] ? quad0 : cnt0;
+	assign enc1 = cnt1;
+	assign enc2 = encMode[1] ? quad1 : cnt2;
+	assign enc3 = cnt3;
+
+	// encoder edge timing: every change of a count toggles its low bit
+	always @ (posedge clk)
+		perDiv <= perDiv + 1;
+
+	// microsecond counter
+	always @ (posedge clk) begin
+		usDiv <= usDiv + 1;
+		if (usDiv == 7)
+			usTime <= usTime + 1;
+	end
+	Period period0(clk,perTick,enc0[0],per0,age0);
+	Period period1(clk,perTick,enc1[0],per1,age1);
+	Period period2(clk,perTick,enc2[0],per2,age2);
+	Period period3(clk,perTick,enc3[0],per3,age3);
 
 	// servo drivers
 	Servo servo0(clk,Servo[0],srv0, srv0_e);
@@ -247,6 +430,16 @@ module happyio(clk, ad, a, aout, ale, nRD, nWR, mot0, mot1, mot2, mot3, mot4, mo
 	Servo servo4(clk,Servo[4],srv4, srv4_e);
 	Servo servo5(clk,Servo[5],srv5, srv5_e);
 
+	// digital input edge counters
+	EdgeCounter edgeCounter0(clk, Digital[0], edge0);
+	EdgeCounter edgeCounter1(clk, Digital[1], edge1);
+	EdgeCounter edgeCounter2(clk, Digital[2], edge2);
+	EdgeCounter edgeCounter3(clk, Digital[3], edge3);
+	EdgeCounter edgeCounter4(clk, Digital[4], edge4);
+	EdgeCounter edgeCounter5(clk, Digital[5], edge5);
+	EdgeCounter edgeCounter6(clk, Digital[6], edge6);
+	EdgeCounter edgeCounter7(clk, Digital[7], edge7);
+
 	// digital IO
 	Pwm pwm0(clk, digitalOutput[0], digitalPwm[0]);
 	Pwm pwm1(clk, digitalOutput[1], digitalPwm[1]);
@@ -0,0 +1,141 @@
+#!/usr/bin/env python
+
+# Decode the binary log records written by src/kern/log.c.
+#
+# usage: logdecode.py <program.elf> [serial port | file]
+#
+# Reads from stdin if no port or file is given. Plain text (printf output) is
+# passed through unchanged; records start with a sync byte and are turned back
+# into text using the format strings stored in the .elf file.
+
+import sys
+import struct
+import re
+
+LOG_SYNC = 0xA5
+LOG_HDR_SIZE = 9
+LEVELS = {1: 'ERROR', 2: 'WARN', 3: 'INFO', 4: 'DEBUG'}
+
+SHT_PROGBITS = 1
+SHF_ALLOC = 2
+
+# flash addresses on the AVR are below the data segment offset
+DATA_OFFSET = 0x800000
+
+CONV = re.compile(r'%([-+ #0]*)(\*|\d+)?(\.(\*|\d+))?([hl]*)([diuxXocpeEfFgGsS%])')
+
+class Elf:
+    def __init__(self, filename):
+        data = open(filename, 'rb').read()
+        if data[:4] != b'\x7fELF':
+            raise ValueError('%s is not an ELF file' % filename)
+        shoff, = struct.unpack_from('<I', data, 0x20)
+        shentsize, shnum = struct.unpack_from('<HH', data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            (name, type, flags, addr, offset, size) = \
+                struct.unpack_from('<IIIIII', data, shoff + i * shentsize)
+            if type == SHT_PROGBITS and flags & SHF_ALLOC and addr < DATA_OFFSET:
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def string(self, addr):
+        for base, contents in self.sections:
+            if base <= addr < base + len(contents):
+                end = contents.find(b'\0', addr - base)
+                return contents[addr - base:end].decode('latin-1')
+        return None
+
+class Args:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, fmt):
+        size = struct.calcsize(fmt)
+        if self.pos + size > len(self.data):
+            raise IndexError
+        value, = struct.unpack_from(fmt, self.data, self.pos)
+        self.pos += size
+        return value
+
+    def string(self):
+        n = self.take('<B')
+        s = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return s.decode('latin-1')
+
+def format_record(elf, fmt, args):
+    def conv(m):
+        flags, width, _, prec, mods, c = m.groups()
+        if c == '%':
+            return '%'
+        try:
+            if width == '*':
+                width = str(args.take('<h'))
+            if prec == '*':
+                prec = str(args.take('<h'))
+            spec = '%' + flags + (width or '') + ('.' + prec if prec else '')
+            if c in 'di':
+                return (spec + 'd') % args.take('<l' if 'l' in mods else '<h')
+            if c in 'uxXo':
+                return (spec + c.replace('u', 'd')) % \
+                    args.take('<L' if 'l' in mods else '<H')
+            if c == 'c':
+                return (spec + 'c') % chr(args.take('<H') & 0xFF)
+            if c == 'p':
+                return (spec + 's') % ('0x%x' % args.take('<H'))
+            if c in 'eEfFgG':
+                return (spec + c) % args.take('<f')
+            if c == 's':
+                return (spec + 's') % args.string()
+            if c == 'S':
+                addr = args.take('<H')
+                return (spec + 's') % (elf.string(addr) or '<%04x>' % addr)
+        except IndexError:
+            return '?'
+    return CONV.sub(conv, fmt)
+
+def decode(elf, read, write):
+    while True:
+        b = read(1)
+        if not b:
+            break
+        if ord(b) != LOG_SYNC:
+            write(b.decode('latin-1'))
+            continue
+        hdr = b + read(LOG_HDR_SIZE - 1)
+        if len(hdr) < LOG_HDR_SIZE:
+            break
+        level, length, id, time = struct.unpack('<BBHI', hdr[1:])
+        args = read(length)
+        fmt = elf.string(id)
+        if fmt is None:
+            write('[%8d] ???: bad format id %04x\n' % (time, id))
+            continue
+        write('[%8d] %s: %s\n' % (time, LEVELS.get(level, '?'),
+            format_record(elf, fmt, Args(args))))
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write('usage: %s <program.elf> [serial port | file]\n' % sys.argv[0])
+        sys.exit(1)
+
+    elf = Elf(sys.argv[1])
+
+    def write(s):
+        sys.stdout.write(s)
+        sys.stdout.flush()
+
+    if len(sys.argv) < 3:
+        stdin = getattr(sys.stdin, 'buffer', sys.stdin)
+        decode(elf, stdin.read, write)
+    elif sys.argv[2].startswith('/dev/') or sys.argv[2].startswith('COM'):
+        import serial
+        port = serial.Serial(sys.argv[2], 19200)
+        decode(elf, port.read, write)
+        port.close()
+    else:
+        decode(elf, open(sys.argv[2], 'rb').read, write)
+
+if __name__ == '__main__':
+    main()
@@ -13,8 +13,6 @@ float cannon_motor_setpoint;
 
 int target_ready;
 
-uint32_t last_update;
-
 struct pid_controller cannon_controller;
 
 int cannon_thread_id;
@@ -109,8 +107,6 @@ int cannon_init(void) {
 }
 
 int cannon_start(void) {
-    last_update = get_time_us();
-    
     cannon_thread_id = create_thread(cannon_loop, 
                 STACK_DEFAULT, CANNON_THREAD_PRIORITY, "cannon_loop");
     
@@ -131,19 +127,16 @@ int cannon_loop(void) {
     while (1) {
         acquire(&cannon_data_lock);
         
-        uint16_t revs = encoder_read(CANNON_ENCODER_PORT);
-        uint32_t ellapsed = (get_time_us() - last_update);
-        cannon_current_rpm = (60.0 * 1000000 / 6) * ((float) revs) / (ellapsed);
+        // encoder_get_velocity() is in thousandths of a tick per second,
+        // with 6 ticks per revolution
+        int32_t vel = encoder_get_velocity(CANNON_ENCODER_PORT);
+        cannon_current_rpm = (60.0 / 1000 / 6) * ((float) vel);
         
         update_pid(&cannon_controller);
         
-        encoder_reset(CANNON_ENCODER_PORT);
-        last_update = get_time_us();
-        
         release(&cannon_data_lock);
         
-        //pause(50 * (ellapsed / 1000) / ((float) revs));      // Wait for ~50 clicks
-        pause(300);
+        pause(50);
     }
     
     return 0;
@@ -18,11 +18,16 @@ void platform_init(void) {
     printf("Calibrating gyro...");
     pause(100);
     gyro_init(GYRO_PORT, LSB_US_PER_DEG, 1000L);
+    // only the drive wheels move the robot; the cannon flywheel runs all
+    // match and would otherwise stop the gyro offset tracking
+    gyro_set_drive_motors((1 << L_MOTOR_PORT) | (1 << R_MOTOR_PORT));
     printf("done.\n");
     
     init_lock(&pause_lock, "pause_lock");
     
-    // Set initial servo positions
+    // Set servo travel limits and initial positions
+    servo_set_range(TRIGGER_SERVO_PORT, TRIGGER_LOWER_LIMIT, TRIGGER_UPPER_LIMIT);
+    servo_set_range(LEVER_SERVO_PORT, LEVER_LOWER_LIMIT, LEVER_UPPER_LIMIT);
     triggerBack();
     leverUp();
 }
@@ -56,6 +61,7 @@ float getHeading(void) {
 }
 
 void setLRMotors(int16_t l_vel, int16_t r_vel) {
+    int16_t vels[6];
     int paused;
     acquire(&pause_lock);
     paused = platform_pause;
@@ -111,8 +117,9 @@ void setLRMotors(int16_t l_vel, int16_t r_vel) {
 	      l_vel = -(pastR_vel - SETPOINT_MAX_DERIV);
       }
     }
-    motor_set_vel(L_MOTOR_PORT, -r_vel);
-    motor_set_vel(R_MOTOR_PORT, -l_vel);
+    vels[L_MOTOR_PORT] = -r_vel;
+    vels[R_MOTOR_PORT] = -l_vel;
+    motor_set_vels((1 << L_MOTOR_PORT) | (1 << R_MOTOR_PORT), vels);
     pastR_vel = -l_vel;
     pastL_vel = -r_vel;
   
@@ -133,8 +140,9 @@ void setLRMotors(int16_t l_vel, int16_t r_vel) {
       }
     }    
     
-    motor_set_vel(L_MOTOR_PORT, l_vel);
-    motor_set_vel(R_MOTOR_PORT, r_vel);
+    vels[L_MOTOR_PORT] = l_vel;
+    vels[R_MOTOR_PORT] = r_vel;
+    motor_set_vels((1 << L_MOTOR_PORT) | (1 << R_MOTOR_PORT), vels);
     pastR_vel = r_vel;
     pastL_vel = l_vel;
   }
@@ -147,12 +155,7 @@ void triggerBack(void) {
     setTriggerPosition(TRIGGER_UPPER_LIMIT);
 }
 void setTriggerPosition(uint16_t pos) {
-    if (pos < TRIGGER_LOWER_LIMIT) {
-        pos = TRIGGER_LOWER_LIMIT;
-    } else if (pos > TRIGGER_UPPER_LIMIT) {
-        pos = TRIGGER_UPPER_LIMIT;
-    }
-    
+    // clamped to the range set in platform_init()
     servo_set_pos(TRIGGER_SERVO_PORT, pos);
 }
 
@@ -163,11 +166,6 @@ void leverDown(void) {
     setLeverPosition(LEVER_UPPER_LIMIT);
 }
 void setLeverPosition(uint16_t pos) {
-    if (pos < LEVER_LOWER_LIMIT) {
-        pos = LEVER_LOWER_LIMIT;
-    } else if (pos > LEVER_UPPER_LIMIT) {
-        pos = LEVER_UPPER_LIMIT;
-    }
-    
+    // clamped to the range set in platform_init()
     servo_set_pos(LEVER_SERVO_PORT, pos);
 }
@@ -68,7 +68,7 @@ void capture_territory(uint8_t territory) {
     while (game.territories[territory].owner != robot_id && \
         (get_time_us() - start_time) < timeout) {
             
-            copy_objects();
+            game_wait_update(50);
             
     }
     